@@ -0,0 +1,38 @@
+# Serene Programming Language
+#
+# Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 2.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Generate the manifest of the prebuilt serene.core. The engine only
+# loads the prebuilt core if the manifest matches its own version and
+# target and the size of the object.
+#
+# Usage:
+#   cmake -DCORE_OBJECT=<path> -DMANIFEST=<path> -DVERSION=<version> \
+#         -DTRIPLE=<triple> [-DDEPS=<ns1,ns2>] -P GenerateCoreManifest.cmake
+
+foreach(var CORE_OBJECT MANIFEST VERSION TRIPLE)
+  if(NOT DEFINED ${var})
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+file(SIZE ${CORE_OBJECT} CORE_OBJECT_SIZE)
+
+file(WRITE ${MANIFEST}
+  "namespace=serene.core\n"
+  "version=${VERSION}\n"
+  "triple=${TRIPLE}\n"
+  "size=${CORE_OBJECT_SIZE}\n"
+  "deps=${DEPS}\n")
@@ -0,0 +1,97 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Atoms are the shared, synchronous and uncoordinated references of
+  `serene.core`, like the ones of Clojure. An atom holds a single value
+  in a 64 bit word and every change is a compare and swap of that word,
+  so readers never wait and writers never take a lock. `swap!` applies a
+  function to the current value and retries if another thread got there
+  first, so the function should be free of side effects.
+
+  The values are compared by identity, which is the word itself. Fixnums,
+  characters and booleans are equal if they are the same value, and heap
+  objects if they are the same object.
+
+  A watch is a function that gets called after every change of the atom
+  with the old and the new value, on the thread that made the change. The
+  watches are an immutable list that is replaced with a compare and swap
+  too, so adding and removing a watch doesn't block the writers either.
+
+  The code generator emits `deref`, `reset!`, `compare-and-set!` and
+  `swap!` inline as atomic instructions (see `serene/jit/values.h`) and
+  only calls `atomNotifyWatches` if the atom has any watches. The layout
+  of `Atom` is shared with it through `serene/types/value.h`.
+ */
+
+#ifndef SERENE_CORE_ATOM_H
+#define SERENE_CORE_ATOM_H
+
+#include "serene/core/seq.h"
+#include "serene/export.h"
+#include "serene/types/value.h"
+
+#include <cstdint>
+
+namespace serene {
+
+struct Atom;
+
+/// Called with the key of the watch, the atom and its old and new value.
+using AtomWatchFn = void (*)(void *ctx, Value key, Atom *atom, Value oldValue,
+                             Value newValue);
+
+extern "C" SERENE_EXPORT Atom *atomMake(Value v) asm("serene.core/atom");
+
+extern "C" SERENE_EXPORT Value atomDeref(const Atom *a)
+    asm("serene.core/atom-deref");
+
+/// Set the value of `a` to `v` and return it.
+extern "C" SERENE_EXPORT Value atomReset(Atom *a, Value v)
+    asm("serene.core/reset!");
+
+/// Set the value of `a` to `fn(ctx, old)` and return it. `fn` might run
+/// more than once if other threads change `a` at the same time.
+extern "C" SERENE_EXPORT Value atomSwap(Atom *a, SeqMapFn fn, void *ctx)
+    asm("serene.core/swap!");
+
+/// Set the value of `a` to `newValue` if it's `oldValue`, and return
+/// whether it did.
+extern "C" SERENE_EXPORT bool atomCompareAndSet(Atom *a, Value oldValue,
+                                                Value newValue)
+    asm("serene.core/compare-and-set!");
+
+/// Add a watch to `a` with the given key, replacing the one with the same
+/// key if there is any.
+extern "C" SERENE_EXPORT void atomAddWatch(Atom *a, Value key,
+                                           AtomWatchFn fn, void *ctx)
+    asm("serene.core/add-watch");
+
+extern "C" SERENE_EXPORT void atomRemoveWatch(Atom *a, Value key)
+    asm("serene.core/remove-watch");
+
+/// Call the watches of `a` for a change from `oldValue` to `newValue`.
+/// It's for the code that changes the atom itself, like the inline code of
+/// the code generator.
+extern "C" SERENE_EXPORT void atomNotifyWatches(Atom *a, Value oldValue,
+                                                Value newValue)
+    asm("serene.core/notify-watches");
+
+} // namespace serene
+#endif
@@ -0,0 +1,106 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Channels are the bounded queues of `serene.core` that the stages of a
+  pipeline use to talk to each other, in the style of CSP and
+  `core.async`. Any number of threads can put to and take from the same
+  channel.
+
+  A channel is a ring of cells with a sequence number each, which is the
+  bounded MPMC queue of Dmitry Vyukov. A put or a take claims a cell with
+  a single compare and swap and then publishes it through the sequence
+  number of the cell, so the fast path never takes a lock. The capacity
+  is rounded up to a power of two, and it's two at least.
+
+  When a channel is full (or empty) the blocking operations park the
+  thread on a futex until a take (or a put) happens. The putters and the
+  takers only make the system call to wake the parked threads when there
+  are any. A task of the scheduler that parks gets a spare thread to
+  stand in for it (see `schedulerBeginBlocking`), so a blocked stage of a
+  pipeline never keeps the other stages from running, however few
+  workers there are.
+
+  `alts` waits for the first of a set of operations on different channels
+  to complete. The order that it tries them in is random, so no channel
+  starves the others.
+
+  nil can't be put to a channel, since a take returns nil when the
+  channel is closed and drained.
+ */
+
+#ifndef SERENE_CORE_CHANNEL_H
+#define SERENE_CORE_CHANNEL_H
+
+#include "serene/export.h"
+#include "serene/types/value.h"
+
+#include <cstdint>
+
+namespace serene {
+
+using types::Value;
+
+struct Channel;
+
+/// An operation of `channelAlts`. It's a take if `put` is nil.
+struct ChannelOp {
+  Channel *channel;
+  Value put;
+};
+
+extern "C" SERENE_EXPORT Channel *channelMake(uint64_t capacity)
+    asm("serene.core/chan");
+
+/// Put `v` to `ch` if it has room, and return whether it did. It never
+/// blocks.
+extern "C" SERENE_EXPORT bool channelOffer(Channel *ch, Value v)
+    asm("serene.core/offer!");
+
+/// Take a value from `ch`, or return nil if it's empty. It never blocks.
+extern "C" SERENE_EXPORT Value channelPoll(Channel *ch)
+    asm("serene.core/poll!");
+
+/// Put `v` to `ch`, waiting for room if it's full. Return false if the
+/// channel is closed.
+extern "C" SERENE_EXPORT bool channelPut(Channel *ch, Value v)
+    asm("serene.core/>!!");
+
+/// Take a value from `ch`, waiting for one if it's empty. Return nil if the
+/// channel is closed and there's nothing left in it.
+extern "C" SERENE_EXPORT Value channelTake(Channel *ch)
+    asm("serene.core/<!!");
+
+/// Close `ch`. The values in it can still be taken, but nothing can be
+/// put to it anymore.
+extern "C" SERENE_EXPORT void channelClose(Channel *ch)
+    asm("serene.core/close!");
+
+extern "C" SERENE_EXPORT bool channelIsClosed(const Channel *ch)
+    asm("serene.core/closed?");
+
+/// Wait for one of the `count` operations in `ops` to complete and return
+/// its index. The result is the taken value for a take, or whether the
+/// value was put for a put, and it's stored in `result`.
+extern "C" SERENE_EXPORT uint64_t channelAlts(const ChannelOp *ops,
+                                              uint64_t count, Value *result)
+    asm("serene.core/alts!!");
+
+} // namespace serene
+#endif
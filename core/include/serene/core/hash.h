@@ -0,0 +1,80 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Hashing for the hash based collections of `serene.core`. A collection
+  gets a `KeyTraits` when it's created and uses it to hash and compare its
+  keys. Keys that are compared by identity, like interned symbols and
+  keywords, only need a cheap mix of their bits. Keys that are compared
+  by value compute their hash once and cache it inside of the key itself,
+  like `String` does, so a lookup never hashes the contents of a key
+  twice.
+ */
+
+#ifndef SERENE_CORE_HASH_H
+#define SERENE_CORE_HASH_H
+
+#include "serene/core/vector.h" // for Value
+#include "serene/export.h"
+
+#include <cstdint>
+
+namespace serene {
+
+/// How a hash based collection hashes and compares its keys. Keys that
+/// are the same word are always equal, so `equal` is only called for
+/// different words.
+struct KeyTraits {
+  uint64_t (*hash)(Value key);
+  bool (*equal)(Value a, Value b);
+};
+
+/// A 64 bit, non cryptographic hash of the given bytes.
+extern "C" SERENE_EXPORT uint64_t hashBytes(const void *data, uint64_t len)
+    asm("serene.core/hash-bytes");
+
+/// Compare the keys by identity and hash the key words themselves.
+extern "C" SERENE_EXPORT const KeyTraits *identityKeyTraits()
+    asm("serene.core/identity-key-traits");
+
+/// An immutable string on the GC heap that carries its own hash.
+struct String;
+
+/// Copy the given bytes into a new string and hash them.
+extern "C" SERENE_EXPORT const String *stringMake(const char *data,
+                                                  uint64_t len)
+    asm("serene.core/string");
+
+/// Return the bytes of the string. They are NUL terminated.
+extern "C" SERENE_EXPORT const char *stringData(const String *s)
+    asm("serene.core/string-data");
+
+extern "C" SERENE_EXPORT uint64_t stringLength(const String *s)
+    asm("serene.core/string-length");
+
+/// Return the cached hash of the string.
+extern "C" SERENE_EXPORT uint64_t stringHash(const String *s)
+    asm("serene.core/string-hash");
+
+/// Compare `String` keys by their contents.
+extern "C" SERENE_EXPORT const KeyTraits *stringKeyTraits()
+    asm("serene.core/string-key-traits");
+
+} // namespace serene
+#endif
@@ -0,0 +1,189 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The persistent hash map and hash set of `serene.core`. Both are hash
+  array mapped tries with the compact node layout of CHAMP. Every level
+  of the trie uses 5 bits of the 64 bit hash of the key to pick one of 32
+  positions in a node. Instead of 32 slots, a node has two 32 bit bitmaps,
+  one for the positions that hold an entry inline and one for the
+  positions that hold a child node, followed by just the occupied slots.
+  The index of a position in the slots is the popcount of the bitmap
+  below it.
+
+  The tries are kept canonical, a child with a single entry is always
+  inlined into its parent, so the nodes stay small and shallow. Keys with
+  the same 64 bit hash end up in a collision node at the bottom of the
+  trie that stores them inline as a flat array.
+
+  Updates copy the path to the changed node and share the rest. The keys
+  are hashed and compared with the `KeyTraits` of the collection (see
+  `serene/core/hash.h`).
+
+  Like vectors, maps and sets have transient versions with a single owner
+  that change their own nodes in place, for building a collection in one
+  go. See `TransientVector`.
+ */
+
+#ifndef SERENE_CORE_HASH_MAP_H
+#define SERENE_CORE_HASH_MAP_H
+
+#include "serene/core/hash.h"
+#include "serene/core/vector.h" // for Value
+#include "serene/export.h"
+
+#include <cstdint>
+
+namespace serene {
+
+struct HashMap;
+struct HashSet;
+
+/// Called with every key and value of a map, in no particular order.
+using HashMapVisitor = void (*)(void *ctx, Value key, Value value);
+/// Called with every element of a set, in no particular order.
+using HashSetVisitor = void (*)(void *ctx, Value key);
+
+// Maps ======================================================================
+
+extern "C" SERENE_EXPORT const HashMap *hashMapEmpty(const KeyTraits *traits)
+    asm("serene.core/hash-map-empty");
+
+extern "C" SERENE_EXPORT uint64_t hashMapCount(const HashMap *m)
+    asm("serene.core/hash-map-count");
+
+/// Return the value of `key` in `m` or `notFound` if there is none.
+extern "C" SERENE_EXPORT Value hashMapGet(const HashMap *m, Value key,
+                                          Value notFound)
+    asm("serene.core/hash-map-get");
+
+extern "C" SERENE_EXPORT bool hashMapContains(const HashMap *m, Value key)
+    asm("serene.core/hash-map-contains");
+
+/// Return a new map with `key` mapped to `value`. Returns `m` itself if
+/// `key` is already mapped to the same value.
+extern "C" SERENE_EXPORT const HashMap *hashMapAssoc(const HashMap *m,
+                                                     Value key, Value value)
+    asm("serene.core/hash-map-assoc");
+
+/// Return a new map without `key`. Returns `m` itself if there is no
+/// `key` in it.
+extern "C" SERENE_EXPORT const HashMap *hashMapDissoc(const HashMap *m,
+                                                      Value key)
+    asm("serene.core/hash-map-dissoc");
+
+extern "C" SERENE_EXPORT void hashMapEach(const HashMap *m,
+                                          HashMapVisitor visit, void *ctx)
+    asm("serene.core/hash-map-each");
+
+// Sets ======================================================================
+
+extern "C" SERENE_EXPORT const HashSet *hashSetEmpty(const KeyTraits *traits)
+    asm("serene.core/hash-set-empty");
+
+extern "C" SERENE_EXPORT uint64_t hashSetCount(const HashSet *s)
+    asm("serene.core/hash-set-count");
+
+extern "C" SERENE_EXPORT bool hashSetContains(const HashSet *s, Value key)
+    asm("serene.core/hash-set-contains");
+
+/// Return a new set with `key` in it. Returns `s` itself if `key` is
+/// already in it.
+extern "C" SERENE_EXPORT const HashSet *hashSetConj(const HashSet *s,
+                                                    Value key)
+    asm("serene.core/hash-set-conj");
+
+/// Return a new set without `key`. Returns `s` itself if `key` is not in
+/// it.
+extern "C" SERENE_EXPORT const HashSet *hashSetDisj(const HashSet *s,
+                                                    Value key)
+    asm("serene.core/hash-set-disj");
+
+extern "C" SERENE_EXPORT void hashSetEach(const HashSet *s,
+                                          HashSetVisitor visit, void *ctx)
+    asm("serene.core/hash-set-each");
+
+// Building ==================================================================
+
+/// Create a map from the given slice of `Value`s, which holds the keys and
+/// the values in turns. Later keys win.
+extern "C" SERENE_EXPORT const HashMap *hashMapFrom(const KeyTraits *traits,
+                                                    types::Slice keyValues)
+    asm("serene.core/hash-map-from");
+
+/// Create a set from the given slice of `Value`s.
+extern "C" SERENE_EXPORT const HashSet *hashSetFrom(const KeyTraits *traits,
+                                                    types::Slice keys)
+    asm("serene.core/hash-set-from");
+
+struct TransientHashMap;
+struct TransientHashSet;
+
+/// Return a transient copy of `m`. It's O(1), `m` itself stays unchanged.
+extern "C" SERENE_EXPORT TransientHashMap *hashMapTransient(const HashMap *m)
+    asm("serene.core/transient-hash-map");
+
+extern "C" SERENE_EXPORT uint64_t
+transientHashMapCount(const TransientHashMap *t)
+    asm("serene.core/transient-hash-map-count");
+
+extern "C" SERENE_EXPORT Value transientHashMapGet(const TransientHashMap *t,
+                                                   Value key, Value notFound)
+    asm("serene.core/transient-hash-map-get");
+
+extern "C" SERENE_EXPORT void transientHashMapAssoc(TransientHashMap *t,
+                                                    Value key, Value value)
+    asm("serene.core/hash-map-assoc!");
+
+extern "C" SERENE_EXPORT void transientHashMapDissoc(TransientHashMap *t,
+                                                     Value key)
+    asm("serene.core/hash-map-dissoc!");
+
+/// Return a persistent map with the entries of `t` in O(1). `t` can't be
+/// used after that.
+extern "C" SERENE_EXPORT const HashMap *hashMapPersistent(TransientHashMap *t)
+    asm("serene.core/hash-map-persistent!");
+
+/// Return a transient copy of `s`. It's O(1), `s` itself stays unchanged.
+extern "C" SERENE_EXPORT TransientHashSet *hashSetTransient(const HashSet *s)
+    asm("serene.core/transient-hash-set");
+
+extern "C" SERENE_EXPORT uint64_t
+transientHashSetCount(const TransientHashSet *t)
+    asm("serene.core/transient-hash-set-count");
+
+extern "C" SERENE_EXPORT bool
+transientHashSetContains(const TransientHashSet *t, Value key)
+    asm("serene.core/transient-hash-set-contains");
+
+extern "C" SERENE_EXPORT void transientHashSetConj(TransientHashSet *t,
+                                                   Value key)
+    asm("serene.core/hash-set-conj!");
+
+extern "C" SERENE_EXPORT void transientHashSetDisj(TransientHashSet *t,
+                                                   Value key)
+    asm("serene.core/hash-set-disj!");
+
+/// Return a persistent set with the elements of `t` in O(1). `t` can't be
+/// used after that.
+extern "C" SERENE_EXPORT const HashSet *hashSetPersistent(TransientHashSet *t)
+    asm("serene.core/hash-set-persistent!");
+
+} // namespace serene
+#endif
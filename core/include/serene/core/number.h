@@ -0,0 +1,127 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The integer arithmetic of `serene.core`. An integer is either a fixnum
+  (see `serene/types/value.h`) or a `BigInt` on the heap. Results are
+  always normalized: an integer that fits in a fixnum is never a bignum,
+  so two integers are equal only if both are fixnums with the same word
+  or both are bignums with the same digits.
+
+  The inline `fast*` functions do the fixnum case right here and only
+  call the out of line functions when an argument is a bignum or the
+  result overflows. The code generator emits the same fast path (see
+  `serene/jit/values.h`), so the common case never leaves the caller and
+  never allocates.
+ */
+
+#ifndef SERENE_CORE_NUMBER_H
+#define SERENE_CORE_NUMBER_H
+
+#include "serene/export.h"
+#include "serene/types/value.h"
+
+#include <cstdint>
+
+namespace serene {
+
+using types::Value;
+
+/// An arbitrary precision integer on the GC heap.
+struct BigInt;
+
+/// Return the given integer as a fixnum if it fits, or a bignum.
+extern "C" SERENE_EXPORT Value numberFromInt64(int64_t i)
+    asm("serene.core/int");
+
+/// Store the value of the integer `n` in `out` and return true if it fits
+/// in 64 bits.
+extern "C" SERENE_EXPORT bool numberToInt64(Value n, int64_t *out)
+    asm("serene.core/to-int64");
+
+/// Whether `v` is an integer at all.
+extern "C" SERENE_EXPORT bool numberIsInteger(Value v)
+    asm("serene.core/integer?");
+
+// The arithmetic takes integers only and promotes to bignums on overflow.
+extern "C" SERENE_EXPORT Value numberAdd(Value a, Value b)
+    asm("serene.core/+");
+extern "C" SERENE_EXPORT Value numberSubtract(Value a, Value b)
+    asm("serene.core/-");
+extern "C" SERENE_EXPORT Value numberMultiply(Value a, Value b)
+    asm("serene.core/*");
+
+extern "C" SERENE_EXPORT bool numberEqual(Value a, Value b)
+    asm("serene.core/==");
+extern "C" SERENE_EXPORT bool numberLessThan(Value a, Value b)
+    asm("serene.core/<");
+
+// The fixnum tag is the lowest bit, so with `a = 2x + 1` and `b = 2y + 1`
+// the words of the results are `a + b - 1`, `a - b + 1` and
+// `(a >> 1) * (b - 1) + 1`. The overflow of the 64 bit operation is
+// exactly the overflow of the 63 bit fixnums.
+
+inline Value fastAdd(Value a, Value b) {
+  int64_t r;
+  auto x = static_cast<int64_t>(types::toWord(a));
+  auto y = static_cast<int64_t>(types::toWord(b));
+
+  if (types::isFixnum(a) && types::isFixnum(b) &&
+      !__builtin_add_overflow(x, y - 1, &r)) {
+    return types::fromWord(static_cast<uintptr_t>(r));
+  }
+  return numberAdd(a, b);
+};
+
+inline Value fastSubtract(Value a, Value b) {
+  int64_t r;
+  auto x = static_cast<int64_t>(types::toWord(a));
+  auto y = static_cast<int64_t>(types::toWord(b));
+
+  if (types::isFixnum(a) && types::isFixnum(b) &&
+      !__builtin_sub_overflow(x, y - 1, &r)) {
+    return types::fromWord(static_cast<uintptr_t>(r));
+  }
+  return numberSubtract(a, b);
+};
+
+inline Value fastMultiply(Value a, Value b) {
+  int64_t r;
+  auto x = static_cast<int64_t>(types::toWord(a));
+  auto y = static_cast<int64_t>(types::toWord(b));
+
+  // The product is even, so adding the tag never overflows
+  if (types::isFixnum(a) && types::isFixnum(b) &&
+      !__builtin_mul_overflow(x >> 1, y - 1, &r)) {
+    return types::fromWord(static_cast<uintptr_t>(r) | types::fixnumTag);
+  }
+  return numberMultiply(a, b);
+};
+
+inline bool fastLessThan(Value a, Value b) {
+  if (types::isFixnum(a) && types::isFixnum(b)) {
+    return static_cast<int64_t>(types::toWord(a)) <
+           static_cast<int64_t>(types::toWord(b));
+  }
+  return numberLessThan(a, b);
+};
+
+} // namespace serene
+
+#endif
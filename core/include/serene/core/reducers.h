@@ -0,0 +1,74 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Parallel folds over the persistent collections, like `fold` of the
+  reducers of Clojure. A fold splits a collection along the nodes of its
+  trie until the parts are no bigger than the grain, reduces the parts on
+  the scheduler (see `serene/core/scheduler.h`) and combines the results
+  of the parts pairwise.
+
+  Every part starts from `init` so `combine` has to be associative with
+  `init` as its identity, e.g. `+` and zero. Vectors combine the parts in
+  order, so `combine` doesn't have to be commutative for them. The parts
+  of maps and sets come in no particular order.
+
+  A collection that is no bigger than the grain is reduced on the calling
+  thread without touching the scheduler.
+ */
+
+#ifndef SERENE_CORE_REDUCERS_H
+#define SERENE_CORE_REDUCERS_H
+
+#include "serene/core/hash_map.h"
+#include "serene/core/seq.h"
+#include "serene/core/vector.h"
+#include "serene/export.h"
+
+#include <cstdint>
+
+namespace serene {
+
+/// The grain of a fold when it's zero
+constexpr uint64_t defaultFoldGrain = 512;
+
+/// Reduces the entries of a map into `acc`.
+using HashMapReducer = Value (*)(void *ctx, Value acc, Value key,
+                                 Value value);
+
+extern "C" SERENE_EXPORT Value vectorFold(const Vector *v, uint64_t grain,
+                                          SeqReducer combine,
+                                          SeqReducer reduce, void *ctx,
+                                          Value init)
+    asm("serene.core/fold-vector");
+
+extern "C" SERENE_EXPORT Value hashMapFold(const HashMap *m, uint64_t grain,
+                                           SeqReducer combine,
+                                           HashMapReducer reduce, void *ctx,
+                                           Value init)
+    asm("serene.core/fold-hash-map");
+
+extern "C" SERENE_EXPORT Value hashSetFold(const HashSet *s, uint64_t grain,
+                                           SeqReducer combine,
+                                           SeqReducer reduce, void *ctx,
+                                           Value init)
+    asm("serene.core/fold-hash-set");
+
+} // namespace serene
+#endif
@@ -0,0 +1,130 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The task scheduler of `serene.core`. It's a pool of worker threads with
+  a Chase-Lev deque each. A worker pushes the tasks that it spawns to the
+  bottom of its own deque and takes them back from there, so the common
+  case never touches a lock or a shared cache line. An idle worker steals
+  the oldest task from the top of the deque of another worker, which
+  tends to be the largest piece of the remaining work. Tasks that are
+  spawned from the threads outside of the pool go to a shared queue.
+
+  The workers are registered with the collector, so tasks can allocate
+  and hold onto GC objects. The queues live in memory that the collector
+  scans, so a queued task keeps its context alive. The threads outside of
+  the pool that spawn tasks or wait for promises have to be registered
+  with the collector as well (see `registerGCThread`).
+
+  A promise is a value that is delivered once and can be waited for. A
+  future is a promise that a task delivers. A worker that waits for a
+  promise runs other tasks in the mean time instead of blocking, so tasks
+  can wait for the tasks that they spawn without running out of workers.
+
+  A task that blocks on anything else, like a channel, gets a spare
+  thread to stand in for it while it's blocked, like the managed blocking
+  of the ForkJoinPool of Java. The spares run tasks like the workers do
+  and go away after they have been idle for a while.
+
+  The scheduler is process wide like the collector. It starts on the
+  first use with a worker per CPU unless `schedulerStart` is called
+  before that.
+ */
+
+#ifndef SERENE_CORE_SCHEDULER_H
+#define SERENE_CORE_SCHEDULER_H
+
+#include "serene/core/seq.h"
+#include "serene/core/vector.h"
+#include "serene/export.h"
+#include "serene/types/value.h"
+
+#include <cstdint>
+
+namespace serene {
+
+using TaskFn   = void (*)(void *ctx);
+using FutureFn = Value (*)(void *ctx);
+
+/// Pin the worker `i` to the CPU `i`, modulo the number of the CPUs. It's
+/// only supported on Linux.
+constexpr uint32_t schedulerPinWorkers = 1;
+
+/// Start the scheduler with the given number of workers, or one per CPU
+/// if it's zero. `flags` is a combination of the `scheduler*` flags.
+/// Return false if the scheduler is running already.
+extern "C" SERENE_EXPORT bool schedulerStart(uint32_t workers, uint32_t flags)
+    asm("serene.core/start-scheduler");
+
+/// Run the remaining tasks and stop the workers. Nothing can be spawned
+/// after that until the scheduler starts again. It can't be called from
+/// a task.
+extern "C" SERENE_EXPORT void schedulerStop()
+    asm("serene.core/stop-scheduler");
+
+/// Return the number of the workers, zero if the scheduler isn't running.
+extern "C" SERENE_EXPORT uint32_t schedulerWorkerCount()
+    asm("serene.core/worker-count");
+
+/// Run `fn(ctx)` on the scheduler.
+extern "C" SERENE_EXPORT void schedulerSpawn(TaskFn fn, void *ctx)
+    asm("serene.core/spawn");
+
+/// Tell the scheduler that the calling task is about to block on
+/// something other than a promise, e.g. a channel. The scheduler starts a
+/// spare thread to stand in for it, so the tasks that would unblock it
+/// still get to run. It does nothing outside of the scheduler.
+extern "C" SERENE_EXPORT void schedulerBeginBlocking()
+    asm("serene.core/begin-blocking");
+
+/// Tell the scheduler that the calling task doesn't block anymore.
+extern "C" SERENE_EXPORT void schedulerEndBlocking()
+    asm("serene.core/end-blocking");
+
+// Promises and futures =======================================================
+
+struct Promise;
+
+extern "C" SERENE_EXPORT Promise *promiseMake() asm("serene.core/promise");
+
+/// Deliver `v` to `p`. Only the first delivery counts and the rest return
+/// false.
+extern "C" SERENE_EXPORT bool promiseDeliver(Promise *p, Value v)
+    asm("serene.core/deliver");
+
+extern "C" SERENE_EXPORT bool promiseIsRealized(const Promise *p)
+    asm("serene.core/realized?");
+
+/// Wait for `p` to be delivered and return its value.
+extern "C" SERENE_EXPORT Value promiseDeref(const Promise *p)
+    asm("serene.core/deref");
+
+/// Return a promise that a task delivers the result of `fn(ctx)` to.
+extern "C" SERENE_EXPORT Promise *futureCall(FutureFn fn, void *ctx)
+    asm("serene.core/future");
+
+/// Return a vector of `fn(ctx, x)` for every element `x` of `v`. The
+/// elements are mapped in parallel on the scheduler, so `fn` should be
+/// pure.
+extern "C" SERENE_EXPORT const Vector *pmap(SeqMapFn fn, void *ctx,
+                                            const Vector *v)
+    asm("serene.core/pmap");
+
+} // namespace serene
+#endif
@@ -0,0 +1,115 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The lazy sequences of `serene.core`. A seq is realized a chunk of up to
+  32 elements at a time instead of an element at a time, so walking a
+  seq costs a thunk call and an allocation per chunk and the elements of
+  a chunk are a plain array. The seq of a vector doesn't copy anything,
+  its chunks are the leaves of the vector.
+
+  `seqMap`, `seqFilter` and `seqReduce` work on whole chunks, so a
+  pipeline like `(reduce + (filter even? (map inc xs)))` runs a tight loop
+  over each chunk and stays lazy at the chunk level. The element wise
+  `seqFirst` and `seqRest` are there too, but `seqRest` allocates a new
+  seq, so the chunk wise functions should be preferred.
+
+  nil, the null pointer, is the empty seq. A lazy seq might turn out to
+  be empty only when it's realized though, e.g. the result of a filter,
+  so use `seqIsEmpty` instead of comparing to nil.
+
+  Seqs are immutable values and they can be shared between threads. A
+  chunk might be realized by two threads at the same time, and then one
+  of the results wins, so the functions that are given to `seqMap` and
+  `seqFilter` should be pure. They are called with the `ctx` they were
+  given along side of them, which has to live as long as the seq does,
+  e.g. on the GC heap.
+ */
+
+#ifndef SERENE_CORE_SEQ_H
+#define SERENE_CORE_SEQ_H
+
+#include "serene/core/vector.h"
+#include "serene/export.h"
+#include "serene/types/types.h"
+#include "serene/types/value.h"
+
+#include <cstdint>
+
+namespace serene {
+
+struct Seq;
+
+using SeqMapFn     = Value (*)(void *ctx, Value x);
+using SeqPredicate = bool (*)(void *ctx, Value x);
+using SeqReducer   = Value (*)(void *ctx, Value acc, Value x);
+
+/// The number of the elements in a full chunk
+constexpr unsigned seqChunkSize = vectorBranching;
+
+/// Return a seq of the elements of `v`.
+extern "C" SERENE_EXPORT const Seq *seqFromVector(const Vector *v)
+    asm("serene.core/vector-seq");
+
+/// Return a seq of the integers from `start` up to, but not including,
+/// `end`.
+extern "C" SERENE_EXPORT const Seq *seqRange(int64_t start, int64_t end)
+    asm("serene.core/range");
+
+extern "C" SERENE_EXPORT bool seqIsEmpty(const Seq *s)
+    asm("serene.core/empty?");
+
+/// Return the first chunk of `s` as a slice of `Value`s. It's empty only
+/// if `s` is empty.
+extern "C" SERENE_EXPORT types::Slice seqChunkFirst(const Seq *s)
+    asm("serene.core/chunk-first");
+
+/// Return the seq of the elements after the first chunk of `s`.
+extern "C" SERENE_EXPORT const Seq *seqChunkRest(const Seq *s)
+    asm("serene.core/chunk-rest");
+
+/// Return the first element of `s`, or nil if it's empty.
+extern "C" SERENE_EXPORT Value seqFirst(const Seq *s)
+    asm("serene.core/first");
+
+/// Return the seq of the elements after the first one.
+extern "C" SERENE_EXPORT const Seq *seqRest(const Seq *s)
+    asm("serene.core/rest");
+
+/// Return a lazy seq of `fn(ctx, x)` for every element `x` of `s`.
+extern "C" SERENE_EXPORT const Seq *seqMap(SeqMapFn fn, void *ctx,
+                                           const Seq *s)
+    asm("serene.core/map");
+
+/// Return a lazy seq of the elements of `s` that `pred` holds for.
+extern "C" SERENE_EXPORT const Seq *seqFilter(SeqPredicate pred, void *ctx,
+                                              const Seq *s)
+    asm("serene.core/filter");
+
+/// Fold the elements of `s` into `init` with `fn`, from left to right.
+extern "C" SERENE_EXPORT Value seqReduce(SeqReducer fn, void *ctx,
+                                         Value init, const Seq *s)
+    asm("serene.core/reduce");
+
+/// Realize the whole `s` into a new vector.
+extern "C" SERENE_EXPORT const Vector *seqToVector(const Seq *s)
+    asm("serene.core/vec");
+
+} // namespace serene
+#endif
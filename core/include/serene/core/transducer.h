@@ -0,0 +1,96 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Transducers for `serene.core`. A transducer is a chain of stages like
+  `map`, `filter`, `take` and `partition-all` that transforms a reducing
+  function. `transduce` pushes every element of the input through all the
+  stages and into the reducing function in one pass, so a pipeline of
+  any length creates no intermediate seqs or collections. The only
+  allocations are the ones the stages themselves produce, e.g. the
+  groups of `partition-all`.
+
+  Transducers are immutable values. The state of the stateful stages,
+  like the count of `take`, belongs to a single run of `transduce`, so a
+  transducer can be used many times and by many threads at once.
+
+  `into` has specialized versions for vectors and hash maps that collect
+  the results in a transient and skip the reducing function entirely.
+
+  The functions of the stages are the same as the ones of the lazy seqs
+  (see `serene/core/seq.h`).
+ */
+
+#ifndef SERENE_CORE_TRANSDUCER_H
+#define SERENE_CORE_TRANSDUCER_H
+
+#include "serene/core/hash_map.h"
+#include "serene/core/seq.h"
+#include "serene/core/vector.h"
+#include "serene/export.h"
+
+#include <cstdint>
+
+namespace serene {
+
+/// A transducer. nil is the identity transducer.
+struct Transducer;
+
+extern "C" SERENE_EXPORT const Transducer *xformMap(SeqMapFn fn, void *ctx)
+    asm("serene.core/map-xf");
+
+extern "C" SERENE_EXPORT const Transducer *xformFilter(SeqPredicate pred,
+                                                       void *ctx)
+    asm("serene.core/filter-xf");
+
+/// Pass the first `n` elements and stop the whole run after them.
+extern "C" SERENE_EXPORT const Transducer *xformTake(uint64_t n)
+    asm("serene.core/take-xf");
+
+/// Group the elements into vectors of `n` elements. The last group might
+/// be shorter.
+extern "C" SERENE_EXPORT const Transducer *xformPartitionAll(uint64_t n)
+    asm("serene.core/partition-all-xf");
+
+/// Return a transducer that runs the stages of `a` and then the ones of
+/// `b`, like `(comp a b)`.
+extern "C" SERENE_EXPORT const Transducer *xformCompose(const Transducer *a,
+                                                        const Transducer *b)
+    asm("serene.core/comp-xf");
+
+/// Reduce the elements of `coll`, transformed by `xf`, into `init` with
+/// `rf`.
+extern "C" SERENE_EXPORT Value transduce(const Transducer *xf, SeqReducer rf,
+                                         void *ctx, Value init,
+                                         const Seq *coll)
+    asm("serene.core/transduce");
+
+/// Append the elements of `coll`, transformed by `xf`, to `to`.
+extern "C" SERENE_EXPORT const Vector *
+transduceIntoVector(const Vector *to, const Transducer *xf, const Seq *coll)
+    asm("serene.core/into-vector");
+
+/// Add the elements of `coll`, transformed by `xf`, to `to`. The elements
+/// have to be vectors of a key and a value.
+extern "C" SERENE_EXPORT const HashMap *
+transduceIntoHashMap(const HashMap *to, const Transducer *xf, const Seq *coll)
+    asm("serene.core/into-hash-map");
+
+} // namespace serene
+#endif
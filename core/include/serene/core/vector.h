@@ -0,0 +1,137 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The persistent vector of `serene.core`. It's a 32-way trie of nodes
+  that hold 32 elements each, plus a tail of up to 32 elements that is
+  not in the trie yet. Updates copy the path from the root to the changed
+  leaf and share everything else with the original vector, so every
+  version of a vector stays valid and immutable.
+
+  The trie is always full on the left, so the path to the element `i` is
+  just the 5 bit chunks of `i` and looking up an element is a few loads
+  without any popcount or search. Appending goes to the tail and only
+  every 32nd append touches the trie. The leaves are plain arrays of 32
+  elements, 256 bytes, so iterating over a vector walks through
+  contiguous memory a chunk at a time (see `vectorChunkAt`).
+
+  Vectors and their nodes live on the GC heap. The elements are values
+  (see `serene/types/value.h`) and the vector never looks into them.
+
+  Building a large vector with `vectorConj` allocates a new tail and a new
+  vector for every element. A `TransientVector` is a mutable vector with
+  a single owner that changes its own nodes in place instead. It's meant
+  for building a vector in one go, e.g. the literals and the results of
+  the loaders, and turning it into a persistent vector at the end in O(1)
+  with `vectorPersistent`.
+ */
+
+#ifndef SERENE_CORE_VECTOR_H
+#define SERENE_CORE_VECTOR_H
+
+#include "serene/export.h"
+#include "serene/types/types.h"
+#include "serene/types/value.h"
+
+#include <cstdint>
+
+namespace serene {
+
+using types::Value;
+
+/// The number of the bits of the index that each level of the trie uses
+constexpr unsigned vectorBits = 5;
+/// The number of the elements in a node of the trie and in a full tail
+constexpr unsigned vectorBranching = 1 << vectorBits;
+
+struct Vector;
+
+/// Return the empty vector. It's shared by all the empty vectors.
+extern "C" SERENE_EXPORT const Vector *vectorEmpty()
+    asm("serene.core/vector-empty");
+
+extern "C" SERENE_EXPORT uint64_t vectorCount(const Vector *v)
+    asm("serene.core/vector-count");
+
+/// Return the element at index `i`. `i` has to be less than the count of
+/// the vector.
+extern "C" SERENE_EXPORT Value vectorNth(const Vector *v, uint64_t i)
+    asm("serene.core/vector-nth");
+
+/// Return a new vector with `x` appended to the end of `v`.
+extern "C" SERENE_EXPORT const Vector *vectorConj(const Vector *v, Value x)
+    asm("serene.core/vector-conj");
+
+/// Return a new vector with the element at index `i` replaced by `x`. If
+/// `i` is the count of the vector it's the same as `vectorConj`.
+extern "C" SERENE_EXPORT const Vector *vectorAssoc(const Vector *v,
+                                                   uint64_t i, Value x)
+    asm("serene.core/vector-assoc");
+
+/// Return a new vector without the last element of `v`. The empty vector
+/// stays empty.
+extern "C" SERENE_EXPORT const Vector *vectorPop(const Vector *v)
+    asm("serene.core/vector-pop");
+
+/// Return the elements from index `i` up to the end of the chunk that
+/// contains it, as a slice of `Value`s. Iterating over a vector a chunk at
+/// a time avoids walking the trie for every element. The slice is empty
+/// if `i` is not less than the count of the vector.
+extern "C" SERENE_EXPORT types::Slice vectorChunkAt(const Vector *v,
+                                                    uint64_t i)
+    asm("serene.core/vector-chunk-at");
+
+/// Create a vector with the given elements, which is a slice of `Value`s.
+extern "C" SERENE_EXPORT const Vector *vectorFrom(types::Slice values)
+    asm("serene.core/vector-from");
+
+// Transients =================================================================
+
+struct TransientVector;
+
+/// Return a transient copy of `v`. It's O(1), `v` itself stays unchanged.
+extern "C" SERENE_EXPORT TransientVector *vectorTransient(const Vector *v)
+    asm("serene.core/transient-vector");
+
+extern "C" SERENE_EXPORT uint64_t
+transientVectorCount(const TransientVector *t)
+    asm("serene.core/transient-vector-count");
+
+extern "C" SERENE_EXPORT Value transientVectorNth(const TransientVector *t,
+                                                  uint64_t i)
+    asm("serene.core/transient-vector-nth");
+
+/// Append `x` to the end of `t` in place.
+extern "C" SERENE_EXPORT void transientVectorConj(TransientVector *t,
+                                                  Value x)
+    asm("serene.core/vector-conj!");
+
+/// Replace the element at index `i` of `t` in place. `i` has to be less
+/// than the count of `t`.
+extern "C" SERENE_EXPORT void transientVectorAssoc(TransientVector *t,
+                                                   uint64_t i, Value x)
+    asm("serene.core/vector-assoc!");
+
+/// Return a persistent vector with the elements of `t` in O(1). `t` can't
+/// be used after that.
+extern "C" SERENE_EXPORT const Vector *vectorPersistent(TransientVector *t)
+    asm("serene.core/vector-persistent!");
+
+} // namespace serene
+#endif
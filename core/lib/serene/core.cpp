@@ -16,5 +16,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "atom.cpp.inc"
+#include "channel.cpp.inc"
 #include "compiler.cpp.inc"
+#include "hash.cpp.inc"
+#include "hash_map.cpp.inc"
+#include "number.cpp.inc"
 #include "reader.cpp.inc"
+#include "reducers.cpp.inc"
+#include "scheduler.cpp.inc"
+#include "seq.cpp.inc"
+#include "transducer.cpp.inc"
+#include "vector.cpp.inc"
@@ -0,0 +1,109 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The set of the trie nodes that a transient collection owns. A transient
+  can change the nodes that it created itself in place, since nobody else
+  has seen them, but it has to copy the nodes that it shares with the
+  persistent collection that it came from.
+
+  The nodes themselves have no room for an owner field. Vector nodes are
+  exactly the largest size that the inline allocation path handles. So the
+  transient keeps the owned nodes in this set instead and freezing it is
+  just dropping the set. It's an open addressing table on the GC heap,
+  since it points to GC objects.
+ */
+
+#ifndef SERENE_CORE_OWNED_NODES_H
+#define SERENE_CORE_OWNED_NODES_H
+
+#include "serene/gc.h"
+
+#include <cstdint>
+
+namespace serene {
+
+class OwnedNodes {
+  const void **slots = nullptr;
+  /// Always zero or a power of two
+  uint64_t capacity = 0;
+  uint64_t size     = 0;
+
+  static uint64_t slotFor(const void *node, uint64_t capacity) {
+    // Nodes are at least 16 bytes apart, the low bits are always zero
+    auto x = reinterpret_cast<uintptr_t>(node) >> 4;
+    x *= 0x9e3779b97f4a7c15ULL;
+    return (x >> 32) & (capacity - 1);
+  };
+
+  void grow() {
+    auto *old   = slots;
+    auto oldCap = capacity;
+
+    capacity = capacity == 0 ? 64 : capacity * 2;
+    slots    = static_cast<const void **>(allocate(capacity * sizeof(void *)));
+
+    for (uint64_t i = 0; i < oldCap; i++) {
+      if (old[i] != nullptr) {
+        auto j = slotFor(old[i], capacity);
+        while (slots[j] != nullptr) {
+          j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = old[i];
+      }
+    }
+  };
+
+public:
+  bool contains(const void *node) const {
+    if (capacity == 0) {
+      return false;
+    }
+
+    for (auto i = slotFor(node, capacity);; i = (i + 1) & (capacity - 1)) {
+      if (slots[i] == node) {
+        return true;
+      }
+      if (slots[i] == nullptr) {
+        return false;
+      }
+    }
+  };
+
+  void insert(const void *node) {
+    // Keep the load under a half, so the probes stay short
+    if ((size + 1) * 2 > capacity) {
+      grow();
+    }
+
+    auto i = slotFor(node, capacity);
+    while (slots[i] != nullptr) {
+      if (slots[i] == node) {
+        return;
+      }
+      i = (i + 1) & (capacity - 1);
+    }
+    slots[i] = node;
+    size++;
+  };
+};
+
+} // namespace serene
+
+#endif
@@ -0,0 +1,36 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "./allocation.cpp.inc"
+#include "./atom.cpp.inc"
+#include "./call_overhead.cpp.inc"
+#include "./channel.cpp.inc"
+#include "./forms.cpp.inc"
+#include "./hash_map.cpp.inc"
+#include "./numbers.cpp.inc"
+#include "./reducers.cpp.inc"
+#include "./scheduler.cpp.inc"
+#include "./seq.cpp.inc"
+#include "./startup.cpp.inc"
+#include "./symbols.cpp.inc"
+#include "./transducer.cpp.inc"
+#include "./vector.cpp.inc"
+
+#include <benchmark/benchmark.h>
+
+BENCHMARK_MAIN();
@@ -0,0 +1,83 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The compiler creates lots of small objects, like namespaces and interned
+  strings, that no JIT compiled code can reach. Putting them on the GC heap
+  makes the collector scan and track memory that we can free on our own,
+  all at once. Instead, they go into an `Arena` that is tied to the life
+  time of what they belong to, e.g. the engine or the load of a namespace.
+
+  Rule of thumb: Only the values that JIT compiled code can reach belong to
+  the GC heap. The rest belongs to an arena.
+ */
+
+#ifndef SERENE_ARENA_H
+#define SERENE_ARENA_H
+
+#include <llvm/Support/Allocator.h>
+
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace serene {
+
+/// A thread safe bump allocator. Objects in an arena never get destroyed
+/// one by one. All of them go away with the arena itself or on `reset`, so
+/// they must be trivially destructible.
+class Arena {
+  std::mutex lock;
+  llvm::BumpPtrAllocator allocator;
+
+public:
+  Arena()              = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t size, size_t alignment) {
+    std::lock_guard<std::mutex> guard(lock);
+    return allocator.Allocate(size, llvm::Align(alignment));
+  };
+
+  /// Create an instance of `T` in the arena with the given `args`.
+  template <typename T, typename... Args>
+  T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Arena never runs the destructors");
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  };
+
+  /// Free everything in the arena at once.
+  void reset() {
+    std::lock_guard<std::mutex> guard(lock);
+    allocator.Reset();
+  };
+
+  size_t getBytesAllocated() {
+    std::lock_guard<std::mutex> guard(lock);
+    return allocator.getBytesAllocated();
+  };
+};
+
+} // namespace serene
+
+#endif
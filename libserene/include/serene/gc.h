@@ -0,0 +1,139 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The values that JIT compiled code can reach live on the heap of the
+  Boehm collector. The collector is process wide, so its configuration and
+  statistics are process wide too. `serene::Options` has the tuning knobs
+  and `getGCStats` reports what the collector has been doing, so hosts can
+  trade memory for latency per deployment.
+
+  Small objects don't go through a full call into the collector. Each
+  thread has a set of free lists, one per size class, that
+  `GC_malloc_many` refills in bulk. Allocating is popping the head of a
+  free list, and only an empty list takes the slow path. JIT compiled code
+  does the same inline (see `jit::emitAllocation`) and the host uses
+  `allocate`.
+ */
+
+#ifndef SERENE_GC_H
+#define SERENE_GC_H
+
+#include "serene/export.h"
+#include "serene/options.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace serene {
+
+struct GCStats {
+  /// The size of the heap in bytes, including the free and unmapped parts
+  uint64_t heapSize = 0;
+  /// The free bytes in the heap
+  uint64_t freeBytes = 0;
+  /// The bytes allocated since the last collection
+  uint64_t bytesSinceLastGC = 0;
+  /// The number of collections so far
+  uint64_t gcCount = 0;
+  /// The total time that the world was stopped for collections
+  std::chrono::microseconds totalPauseTime{0};
+  /// The longest time that the world was stopped for a collection
+  std::chrono::microseconds maxPauseTime{0};
+};
+
+/// Apply the options of the collector that have to be set before it
+/// starts and start measuring the pauses. `SERENE_INIT_WITH_OPTIONS` calls
+/// it right before `GC_INIT`.
+SERENE_EXPORT void prepareGC(const Options &opts);
+
+/// Apply the options of the collector that can change at any time.
+/// `makeEngine` calls it.
+SERENE_EXPORT void configureGC(const Options &opts);
+
+SERENE_EXPORT GCStats getGCStats();
+
+/// Objects are allocated in multiples of this size.
+constexpr size_t allocationGranule = 16;
+/// Objects up to this many granules come from the thread local free lists
+/// and the rest from `GC_malloc`.
+constexpr size_t maxInlineAllocationGranules = 16;
+
+/// The thread local free lists. Objects in a free list are linked through
+/// their first word. The collector sees the lists, so it never reclaims the
+/// objects in them.
+struct AllocationBuffers {
+  /// Indexed by the number of granules. The first one is unused.
+  void *freeLists[maxInlineAllocationGranules + 1];
+};
+
+/// Return the free lists of the current thread. They are created on the
+/// first call on each thread and freed when the thread exits.
+extern "C" SERENE_EXPORT AllocationBuffers *serene_alloc_buffers();
+
+/// Refill the free list of objects of `granules` granules and allocate an
+/// object from it. It's the slow path of `allocate` and the inline
+/// allocations of JIT compiled code.
+extern "C" SERENE_EXPORT void *serene_alloc_slow(AllocationBuffers *buffers,
+                                                 uint64_t granules);
+
+/// Allocate `size` bytes on the GC heap. The memory is zeroed and scanned
+/// for pointers by the collector.
+SERENE_EXPORT void *allocateLarge(size_t size);
+
+/// Allocate `size` bytes that the collector scans for pointers but never
+/// reclaims. It's for the structures of the runtime that might hold the
+/// only references to some objects, like the queues of the scheduler.
+SERENE_EXPORT void *allocateUncollectable(size_t size);
+
+SERENE_EXPORT void freeUncollectable(void *p);
+
+/// Register the calling thread with the collector, so it can stop the
+/// thread and scan its stack. Any thread other than the main one has to
+/// be registered before it touches the GC heap.
+SERENE_EXPORT void registerGCThread();
+
+/// Unregister the calling thread and release its free lists. The thread
+/// must not touch the GC heap afterwards.
+SERENE_EXPORT void unregisterGCThread();
+
+inline void *allocate(size_t size) {
+  auto granules = (size + allocationGranule - 1) / allocationGranule;
+  if (granules == 0 || granules > maxInlineAllocationGranules) {
+    return allocateLarge(size);
+  }
+
+  auto *buffers = serene_alloc_buffers();
+  auto *&head   = buffers->freeLists[granules];
+
+  if (head == nullptr) {
+    return serene_alloc_slow(buffers, granules);
+  }
+
+  auto **link = reinterpret_cast<void **>(head);
+  auto *obj   = head;
+  head        = *link;
+  *link       = nullptr;
+  return obj;
+};
+
+} // namespace serene
+
+#endif
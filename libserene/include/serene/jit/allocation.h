@@ -0,0 +1,66 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Helpers to emit the inline fast path of the GC allocations in the
+  generated code. An allocation of a small constant size pops an object
+  from the free list of its size class in the thread local
+  `AllocationBuffers` (see `serene/gc.h`) and calls into the runtime only
+  when the free list is empty:
+
+    %slot  = getelementptr i8*, i8* %buffers, i64 <granules>
+    %head  = load i8*, i8** %slot
+    %empty = icmp eq i8* %head, null
+    br i1 %empty, label %alloc.slow, label %alloc.fast   ; unlikely
+
+  The buffers should be fetched once per function via
+  `emitGetAllocationBuffers` and reused by all the allocations in it.
+ */
+
+#ifndef SERENE_JIT_ALLOCATION_H
+#define SERENE_JIT_ALLOCATION_H
+
+#include "serene/export.h"
+
+#include <llvm/IR/IRBuilder.h>
+
+#include <cstdint>
+
+namespace llvm {
+class Value;
+} // namespace llvm
+
+namespace serene::jit {
+
+/// Emit a call to the runtime to get the allocation buffers of the current
+/// thread at the insertion point of `builder`.
+SERENE_EXPORT llvm::Value *emitGetAllocationBuffers(llvm::IRBuilder<> &builder);
+
+/// Emit an allocation of `size` bytes on the GC heap at the insertion
+/// point of `builder` and return the pointer to the new object as a value,
+/// an `i8*` or a GC pointer in precise mode (see `usePreciseGC`).
+/// Small allocations use the inline fast path on the given `buffers` and
+/// the rest call `GC_malloc`. The insertion block might get split, and the
+/// builder points right after the allocation when it returns.
+SERENE_EXPORT llvm::Value *emitAllocation(llvm::IRBuilder<> &builder,
+                                          llvm::Value *buffers, uint64_t size);
+
+} // namespace serene::jit
+
+#endif
@@ -0,0 +1,65 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The object cache is content addressed, so a namespace hits the cache
+  only if it produces exactly the same module every time that we compile
+  it. That is not the case out of the box:
+
+  - Anonymous functions are named after a per namespace counter, so the
+    names depend on the order that the compiler visits them.
+  - The module identifier and the source file name are the paths that we
+    loaded the module from, which differ between machines.
+  - The order of functions and globals in the module follows the order
+    of their creation, which ends up in the object file as is.
+
+  `makeModuleDeterministic` normalizes all of the above. The engine runs
+  it on every IR module when `Options::deterministic` is set, right
+  before the module reaches the object cache.
+ */
+
+#ifndef SERENE_JIT_DETERMINISM_H
+#define SERENE_JIT_DETERMINISM_H
+
+#include "serene/export.h"
+
+#include <llvm/ADT/StringRef.h>
+
+namespace llvm {
+class Module;
+} // namespace llvm
+
+namespace serene::jit {
+
+/// Normalize the module `m` in place, so the same code produces the same
+/// module regardless of the order of compilation or the location of the
+/// sources. It:
+///
+/// - Sets the module identifier and the source file name to `name`.
+/// - Renames the local anonymous functions (the ones that start with
+///   `ANONYMOUS_FUNCTION_PREFIX`) after a hash of their bodies, including
+///   the final names of the anonymous functions that they call. Identical
+///   anonymous functions get merged into one.
+/// - Sorts the functions and the global variables by name.
+SERENE_EXPORT void makeModuleDeterministic(llvm::Module &m,
+                                           llvm::StringRef name);
+
+} // namespace serene::jit
+
+#endif
@@ -23,7 +23,8 @@
 
   - It operates in lazy (for REPL) and non-lazy mode and wraps LLJIT
     and LLLazyJIT
-  - It uses an object cache layer to cache module (not NSs) objects.
+  - It uses an object cache layer to cache module (not NSs) objects. The
+    objects may be shared with other engines in the same process.
  */
 
 // TODO: [jit] When we want to load any static or dynamic lib for
@@ -38,26 +39,25 @@
 // from Serene's code and add them to the JitDylib of a namespace
 // instead of having multiple jitDylibs per NS
 
-// TODO: [jit] Create a another overload of the `lookup` function
-// than returns a pointer to the symbol. This new functions will
-// be used to call those core functions that we already know the
-// signature and we don't want to wrap them. For examples functions
-// in the `serene.core` namespace
-
 #ifndef SERENE_JIT_HALLEY_H
 #define SERENE_JIT_HALLEY_H
 
+#include "serene/arena.h"
 #include "serene/context.h" // for Serene...
 #include "serene/export.h"  // for SERENE...
 #include "serene/fs.h"
-#include "serene/types/types.h" // for Intern...
+#include "serene/jit/object_cache.h" // for Object...
+#include "serene/jit/packer.h"       // for Packer
+#include "serene/jit/wrapper_generator.h"
+#include "serene/types/interner.h"   // for Interner
+#include "serene/types/types.h"      // for Intern...
 
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/None.h>
 #include <llvm/ADT/SmallVector.h>                             // for SmallV...
 #include <llvm/ADT/StringMap.h>                               // for StringMap
 #include <llvm/ADT/StringRef.h>                               // for StringRef
-#include <llvm/ExecutionEngine/ObjectCache.h>                 // for Object...
+#include <llvm/ADT/StringSet.h>                               // for StringSet
 #include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h> // for JITTar...
 #include <llvm/ExecutionEngine/Orc/LLJIT.h>                   // for LLJIT
 #include <llvm/Support/Debug.h>                               // for dbgs
@@ -66,9 +66,12 @@
 #include <llvm/Support/MemoryBufferRef.h>                     // for Memory...
 #include <llvm/Support/raw_ostream.h>                         // for raw_os...
 
-#include <memory>   // for unique...
-#include <stddef.h> // for size_t
-#include <vector>   // for vector
+#include <condition_variable> // for condit...
+#include <memory>             // for unique...
+#include <mutex>              // for mutex
+#include <stddef.h>           // for size_t
+#include <string>             // for string
+#include <vector>             // for vector
 
 #define HALLEY_LOG(...)                  \
   DEBUG_WITH_TYPE("halley", llvm::dbgs() \
@@ -76,6 +79,13 @@
 
 #define MAIN_PROCESS_JD_NAME "<process>"
 
+/// The name of the object file section that lists the namespaces that
+/// the namespace in that object file depends on. The content of the
+/// section is a sequence of NUL terminated namespace names.
+/// `Halley::require` loads them first and links the namespace against
+/// them in the same order. Object files without it have no dependencies.
+#define NS_DEPENDENCIES_SECTION "__serene_deps"
+
 namespace llvm {
 class DataLayout;
 class JITEventListener;
@@ -101,27 +111,9 @@ using MaybeJitAddress    = llvm::Expected<JitWrappedAddress>;
 using Dylib              = llvm::orc::JITDylib;
 using DylibPtr           = Dylib *;
 using MaybeDylibPtr      = llvm::Expected<DylibPtr>;
+using MaybeDylibPtrs     = llvm::Expected<std::vector<DylibPtr>>;
 using MaybeNSFileTypeArr = llvm::Optional<llvm::ArrayRef<fs::NSFileType>>;
 
-/// A simple object cache following Lang's LLJITWithObjectCache example and
-/// MLIR's SimpelObjectCache.
-class ObjectCache : public llvm::ObjectCache {
-public:
-  /// Cache the given `objBuffer` for the given module `m`. The buffer contains
-  /// the combiled objects of the module
-  void notifyObjectCompiled(const llvm::Module *m,
-                            llvm::MemoryBufferRef objBuffer) override;
-
-  // Lookup the cache for the given module `m` or returen a nullptr.
-  std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *m) override;
-
-  /// Dump cached object to output file `filename`.
-  void dumpToObjectFile(llvm::StringRef filename);
-
-private:
-  llvm::StringMap<std::unique_ptr<llvm::MemoryBuffer>> cachedObjects;
-};
-
 class SERENE_EXPORT Halley {
   // TODO: Replace this with a variant of LLJIT and LLLazyJIT
   std::unique_ptr<llvm::orc::LLJIT> engine;
@@ -130,6 +122,8 @@ class SERENE_EXPORT Halley {
   llvm::JITEventListener *gdbListener;
   /// Perf notification listener.
   llvm::JITEventListener *perfListener;
+  /// Stack map listener, only in precise GC mode.
+  llvm::JITEventListener *stackMapListener;
   llvm::orc::JITTargetMachineBuilder jtmb;
   // TODO: [cleanup][jit] Since we can access to the data layout via
   // `engine.getDataLayout`, remove this attribute and it's usecases
@@ -139,18 +133,37 @@ class SERENE_EXPORT Halley {
   std::unique_ptr<SereneContext> ctx;
   bool isLazy = false;
 
-  // TODO: [jit] Replace this vector with a thread safe time-optimized
-  // datastructure that is capable of indexing strings and own all
-  // the strings. A lockless algorithm would be even better
+  /// Own all the namespace names and the symbol names. The IDs of the
+  /// former index `nsStorage` and `jitDylibs`.
+  types::Interner nsNames;
+  types::Interner symbolNames;
 
-  /// Owns all the internal strings used in the compilation process
-  std::vector<types::InternalString *> stringStorage;
+  /// Compiler side objects that live as long as the engine. See
+  /// `serene/arena.h`.
+  Arena sessionArena;
 
+  /// Indexed by the ID of the namespace name. Owned by `sessionArena`.
   std::vector<types::Namespace *> nsStorage;
-  // /TODO
 
   // JIT JITDylib related functions ---
-  llvm::StringMap<llvm::SmallVector<llvm::orc::JITDylib *, 1>> jitDylibs;
+  /// Indexed by the ID of the namespace name.
+  std::vector<llvm::SmallVector<llvm::orc::JITDylib *, 1>> jitDylibs;
+
+  /// Guards `nsStorage` and `jitDylibs` since `require` loads independent
+  /// namespaces concurrently.
+  mutable std::mutex tablesLock;
+
+  /// The namespaces that a `require` call is loading right now. Other
+  /// `require` calls wait for them instead of loading them again. Guarded
+  /// by `tablesLock`.
+  llvm::StringSet<> loadingNamespaces;
+  /// Notified whenever a `require` call is done with some of the
+  /// namespaces in `loadingNamespaces`, whether it loaded them or not.
+  std::condition_variable loadingDone;
+
+  /// Signatures of the external functions of the IR modules that we added
+  /// so far. `WrapperGenerator` uses them to define the wrappers lazily.
+  SignatureRegistry signatures;
 
   /// Register the given pointer to a `JITDylib` \p l, with the give \p ns.
   void pushJITDylib(types::Namespace &ns, llvm::orc::JITDylib *l);
@@ -158,8 +171,14 @@ class SERENE_EXPORT Halley {
   // /// Returns the number of registered `JITDylib` for the given \p ns.
   size_t getNumberOfJITDylibs(types::Namespace &ns);
 
+  /// Return the namespace with the given `name` and create it if it
+  /// doesn't exist.
   types::Namespace &makeNamespace(const char *name);
 
+  /// Return the latest `JITDylib` of the namespace with the given ID or
+  /// nullptr if it doesn't have any.
+  DylibPtr getLatestJITDylib(types::StringID nsID) const;
+
   // ==========================================================================
   // Loading namespaces from different sources like source files, objectfiles
   // etc
@@ -176,6 +195,57 @@ class SERENE_EXPORT Halley {
 
   template <fs::NSFileType fileType>
   MaybeDylibPtr loadNamespaceFrom(NSLoadRequest &req);
+
+  /// Describes a namespace that `require` found on the load paths but
+  /// did not load yet.
+  struct NSLocation {
+    std::string nsName;
+    /// The load path that contains the namespace
+    std::string path;
+    std::string nsToFileName;
+    /// Namespaces that this namespace depends on as listed in the
+    /// `NS_DEPENDENCIES_SECTION` of its object file
+    std::vector<std::string> deps;
+  };
+
+  /// Find the object file of the namespace `nsName` on the load paths and
+  /// read its dependencies from it. It does not load the namespace.
+  llvm::Expected<NSLocation> locateNamespace(llvm::StringRef nsName);
+
+  /// Load the namespace described by `loc` and link it against the
+  /// `JITDylib`s of its dependencies and the main process. All the
+  /// dependencies have to be loaded already.
+  MaybeDylibPtr loadLocatedNamespace(NSLocation &loc);
+
+  /// Return a boolean indicating whether any `JITDylib` is registered
+  /// for the namespace `nsName` or not.
+  bool isNamespaceLoaded(llvm::StringRef nsName);
+
+  enum class NSLoadState {
+    /// The namespace has a `JITDylib` already
+    Loaded,
+    /// Another `require` call is loading the namespace
+    Loading,
+    /// The caller has to load the namespace
+    Claimed,
+  };
+
+  /// Claim the namespace `nsName` for the caller to load unless it is
+  /// loaded already or another `require` call is loading it. The caller
+  /// has to release its claims via `releaseNamespaces` once it is done
+  /// with them.
+  NSLoadState claimNamespace(llvm::StringRef nsName);
+  void releaseNamespaces(llvm::ArrayRef<llvm::StringRef> nsNames);
+
+  /// Block until other `require` calls are done with at least one of the
+  /// namespaces in `nsNames`, then move those from `nsNames` to `done`.
+  void waitForNamespaces(std::vector<llvm::StringRef> &nsNames,
+                         std::vector<llvm::StringRef> &done);
+
+  /// Load the prebuilt `serene.core` object if there is one that is built
+  /// for this version of Serene and the current target. Otherwise
+  /// `serene.core` gets loaded from the load paths on `require` as usual.
+  llvm::Error loadPrebuiltCore();
   // ==========================================================================
 
   std::vector<const char *> getContainedNamespaces(llvm::StringRef name,
@@ -183,12 +253,37 @@ class SERENE_EXPORT Halley {
 
   llvm::Error createCurrentProcessJD();
 
+  /// Look up the wrapper of the given `kind` of the function `name`. The
+  /// wrapper gets generated on the first lookup. See `Packer`.
+  llvm::Expected<void *> lookupWrapper(const types::Symbol &name,
+                                       WrapperKind kind) const;
+
+  /// Look up the wrapper of the given `kind` of the function with the
+  /// fully qualified name `fqsym` in the namespace `ns`. If we don't have
+  /// the signature of the function, e.g. it comes from an object file, it
+  /// looks up `fqsym` itself instead of a packed or direct wrapper.
+  llvm::Expected<void *> lookupFunction(llvm::StringRef ns,
+                                        const std::string &fqsym,
+                                        WrapperKind kind) const;
+
+  /// Make sure that all the batch columns have `rows` rows.
+  llvm::Error checkBatchShape(size_t rows,
+                              llvm::ArrayRef<size_t> columnRows) const;
+
 public:
   Halley(std::unique_ptr<SereneContext> ctx,
          llvm::orc::JITTargetMachineBuilder &&jtmb, llvm::DataLayout &&dl);
 
-  // TODO: [jit] Create a function to "require" a namespace as a dependency.
-  // If the namespace already exists return it otherwise call `loadNamespace`.
+  /// Make sure that the given namespaces and all their transitive
+  /// dependencies are loaded and return the `JITDylib`s of the given
+  /// namespaces in the same order. Namespaces that are loaded already will
+  /// not be reloaded. Independent namespaces in the dependency graph are
+  /// loaded in parallel and each `JITDylib` links against the `JITDylib`s
+  /// of its direct dependencies and then the main process. Namespaces that
+  /// another `require` call is loading at the same time are loaded once,
+  /// and this call waits for them instead.
+  MaybeDylibPtrs require(llvm::ArrayRef<llvm::StringRef> nsNames);
+  MaybeDylibPtr require(llvm::StringRef nsName);
 
   /// Load a namespace by exploring the load paths and different file
   /// formats to find the namespace. We assume that we want to load
@@ -210,8 +305,21 @@ public:
   SereneContext &getContext() { return *ctx; };
 
   llvm::Error createEmptyNS(const char *name);
+  /// Intern the given symbol name `s` and return the interned string.
   const types::InternalString &getInternalString(const char *s);
 
+  /// Intern the given namespace name and symbol name and return the
+  /// symbol. Hosts should make the symbols that they call often once and
+  /// keep them around.
+  types::Symbol makeSymbol(llvm::StringRef nsName, llvm::StringRef name);
+
+  llvm::StringRef getNamespaceName(const types::Symbol &sym) const {
+    return nsNames.getString(sym.ns);
+  };
+  llvm::StringRef getSymbolName(const types::Symbol &sym) const {
+    return symbolNames.getString(sym.name);
+  };
+
   /// Return a pointer to the most registered JITDylib of the given \p ns
   ////name
   llvm::orc::JITDylib *getLatestJITDylib(const types::Namespace &ns);
@@ -219,18 +327,104 @@ public:
 
   void setEngine(std::unique_ptr<llvm::orc::LLJIT> e, bool isLazy);
   /// Looks up a packed-argument function with the given sym name and returns a
-  /// pointer to it. Propagates errors in case of failure.
+  /// pointer to it. The wrapper gets defined on the first lookup if the
+  /// function is defined in IR, otherwise it returns the plain symbol
+  /// which has to be a packed function already. Propagates errors in case
+  /// of failure.
   MaybeJitAddress lookup(const char *nsName, const char *sym) const;
   MaybeJitAddress lookup(const types::Symbol &sym) const;
 
+  /// Look up the symbol `symName` in the latest `JITDylib` of the namespace
+  /// `nsName` and return its address as it is. It's useful for calling the
+  /// functions that we already know their signature, e.g. `serene.core`.
+  llvm::Expected<void *> lookupAddress(llvm::StringRef nsName,
+                                       llvm::StringRef symName) const;
+
   /// Invokes the function with the given name passing it the list of opaque
   /// pointers to the actual arguments.
   llvm::Error
   invokePacked(const types::Symbol &name,
                llvm::MutableArrayRef<void *> args = llvm::None) const;
 
+  /// Invokes the function with the given name passing it the given `args`
+  /// and stores its result in `result`. Functions with a signature that
+  /// fits in registers get called via their direct wrappers and the rest
+  /// via their packed wrappers. The choice happens at compile time.
+  template <typename Ret, typename... Args>
+  llvm::Error invoke(const types::Symbol &name, Packer::FnResult<Ret> result,
+                     Args... args) const {
+    if constexpr (Packer::useDirectABI<Ret, Args...>) {
+      auto fn = lookupWrapper(name, WrapperKind::Direct);
+      if (!fn) {
+        return fn.takeError();
+      }
+
+      result.value = Packer::callDirect<Ret>(*fn, args...);
+      return llvm::Error::success();
+    } else {
+      auto fn = lookup(name);
+      if (!fn) {
+        return fn.takeError();
+      }
+
+      Packer::callPacked(*fn, result, args...);
+      return llvm::Error::success();
+    }
+  };
+
+  /// Same as above for the functions without a result.
+  template <typename... Args>
+  llvm::Error invoke(const types::Symbol &name, Args... args) const {
+    if constexpr (Packer::useDirectABI<void, Args...>) {
+      auto fn = lookupWrapper(name, WrapperKind::Direct);
+      if (!fn) {
+        return fn.takeError();
+      }
+
+      Packer::callDirect<void>(*fn, args...);
+      return llvm::Error::success();
+    } else {
+      auto fn = lookup(name);
+      if (!fn) {
+        return fn.takeError();
+      }
+
+      Packer::callPacked(*fn, args...);
+      return llvm::Error::success();
+    }
+  };
+
+  /// Invokes the function with the given name once per row of the given
+  /// `columns` of arguments and stores the results in `results`. The
+  /// function gets looked up once and a JIT compiled loop calls it for
+  /// every row, so there is no per call lookup or packing. All the columns
+  /// must have the same number of rows as `results`.
+  template <typename Ret, typename... Args>
+  llvm::Error invokeBatch(const types::Symbol &name,
+                          llvm::MutableArrayRef<Ret> results,
+                          llvm::ArrayRef<Args>... columns) const {
+    if (auto err = checkBatchShape(results.size(), {columns.size()...})) {
+      return err;
+    }
+
+    auto fn = lookupWrapper(name, WrapperKind::Batch);
+    if (!fn) {
+      return fn.takeError();
+    }
+
+    Packer::callBatch(*fn, results, columns...);
+    return llvm::Error::success();
+  };
+
   llvm::Error loadModule(const char *nsName, const char *file);
   void dumpToObjectFile(llvm::StringRef filename);
+
+  /// Enforce the memory and disk limits of the object cache. Long running
+  /// hosts should call this function periodically.
+  void trimObjectCache();
+
+  /// Return the statistics of the object cache if it is enabled.
+  llvm::Optional<ObjectStoreStats> getObjectCacheStats() const;
 };
 
 MaybeEngine makeHalleyJIT(std::unique_ptr<SereneContext> ctx);
@@ -0,0 +1,227 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The object cache of the JIT has two parts. `ObjectStore` owns the
+  compiled objects and is thread safe, so it can be shared between
+  several engines in the same process. `ObjectCache` is what each engine
+  hands to LLVM. It computes the cache key of each module and talks to
+  the store.
+
+  Keys are the SHA1 of the bitcode of the module and the code generation
+  settings of the engine. So identical modules that are compiled with
+  identical settings share one object buffer no matter which engine
+  compiled them first.
+
+  The store can be bounded in memory and it can persist the objects in a
+  directory that is bounded on its own. Memory entries are evicted in LRU
+  order as soon as the store goes beyond its limit. The directory is pruned
+  on `trim` using LLVM's cache pruning which removes the least recently
+  accessed files first. Objects can optionally be compressed with zlib, in
+  memory and on disk, and they get decompressed into mapped memory on
+  lookup.
+ */
+
+#ifndef SERENE_JIT_OBJECT_CACHE_H
+#define SERENE_JIT_OBJECT_CACHE_H
+
+#include "serene/export.h"
+#include "serene/options.h"
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/MemoryBufferRef.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Module;
+} // namespace llvm
+
+namespace serene::jit {
+
+struct ObjectStoreStats {
+  /// Number of objects in memory
+  size_t entries = 0;
+  /// Number of bytes that the objects occupy in memory (compressed size
+  /// in case of compression)
+  uint64_t memorySize = 0;
+  /// Lookups that found the object in memory
+  uint64_t hits = 0;
+  /// Lookups that found the object on disk
+  uint64_t diskHits = 0;
+  /// Lookups that didn't find the object at all
+  uint64_t misses = 0;
+  /// Objects that got evicted from memory due to the size limit
+  uint64_t evictions = 0;
+};
+
+/// A thread safe, content addressed storage of compiled objects. Objects
+/// are never mutated after they are stored, so the buffers that `get`
+/// returns are read only views into the store which keep the underlying
+/// object alive as long as they exist, even after eviction.
+class SERENE_EXPORT ObjectStore {
+public:
+  /// Create a store using the `JITobjectCache*` settings of `opts`
+  explicit ObjectStore(const Options &opts);
+
+  /// Return the process wide store. It will be created on the first call
+  /// using the given `opts` and will be destroyed when the last engine
+  /// that uses it goes away. The options of the engines that attach to an
+  /// existing store don't change its settings.
+  static std::shared_ptr<ObjectStore> getProcessStore(const Options &opts);
+
+  /// Return a read only view to the object of the given `key` or a
+  /// nullptr if there is no such object in the store or on the disk.
+  std::unique_ptr<llvm::MemoryBuffer> get(llvm::StringRef key);
+
+  /// Store a copy of the given `objBuffer` under the given `key`. If
+  /// there is an object with the same key already, we keep the old one
+  /// since they are identical.
+  void put(llvm::StringRef key, llvm::MemoryBufferRef objBuffer);
+
+  /// Return the number of objects in the store.
+  size_t size() const;
+
+  ObjectStoreStats getStats() const;
+
+  /// Enforce the size limits of the store. It evicts objects from memory
+  /// and prunes the cache directory. Expired objects on disk will be
+  /// removed as well.
+  void trim();
+
+private:
+  struct Entry {
+    /// The object itself or its compressed form
+    std::shared_ptr<llvm::MemoryBuffer> obj;
+    /// The size of the object when it is not compressed
+    size_t objSize;
+    bool isCompressed;
+    uint64_t hits = 0;
+    /// Position of the entry in the `lru` list
+    std::list<llvm::StringRef>::iterator lruPos;
+  };
+
+  const uint64_t maxMemorySize;
+  const uint64_t maxDiskSize;
+  const std::string dir;
+  const bool compress;
+
+  mutable std::mutex lock;
+  llvm::StringMap<Entry> objects;
+  /// Keys of the `objects` from the most recently used to the least. The
+  /// strings are owned by `objects`.
+  std::list<llvm::StringRef> lru;
+  ObjectStoreStats stats;
+
+  /// Add an entry for the given object to memory. The `lock` must be held.
+  void insert(llvm::StringRef key, std::shared_ptr<llvm::MemoryBuffer> obj,
+              size_t objSize, bool isCompressed);
+  /// Evict objects until we're under the memory limit. The `lock` must be
+  /// held.
+  void evict();
+
+  std::string getPathFor(llvm::StringRef key) const;
+  void writeToDisk(llvm::StringRef key, llvm::StringRef data) const;
+  std::unique_ptr<llvm::MemoryBuffer> readFromDisk(llvm::StringRef key) const;
+};
+
+/// A simple object cache following Lang's LLJITWithObjectCache example and
+/// MLIR's SimpelObjectCache that keeps the objects in an `ObjectStore`.
+class SERENE_EXPORT ObjectCache : public llvm::ObjectCache {
+public:
+  explicit ObjectCache(std::shared_ptr<ObjectStore> store)
+      : store(std::move(store)){};
+
+  /// Set the description of the code generation settings (target, cpu,
+  /// features, optimization level, etc) that take part in the cache keys.
+  /// Objects that are compiled with different settings never share a key.
+  void setCodeGenSettings(std::string settings);
+
+  /// Cache the given `objBuffer` for the given module `m`. The buffer contains
+  /// the combiled objects of the module
+  void notifyObjectCompiled(const llvm::Module *m,
+                            llvm::MemoryBufferRef objBuffer) override;
+
+  // Lookup the cache for the given module `m` or returen a nullptr.
+  std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *m) override;
+
+  /// Forget the key that `getObject` computed for `m`, since it's not
+  /// going to be compiled after all.
+  void discardPendingKey(const llvm::Module *m);
+
+  /// Dump cached object to output file `filename`.
+  void dumpToObjectFile(llvm::StringRef filename);
+
+  ObjectStore &getStore() { return *store; };
+
+private:
+  std::shared_ptr<ObjectStore> store;
+
+  std::mutex lock;
+  std::string codegenSettings;
+
+  /// The keys that we computed in `getObject` for the modules that we
+  /// are about to compile, so `notifyObjectCompiled` doesn't have to
+  /// hash them again. Only `notifyObjectCompiled` and a failed compilation
+  /// take them out, since the address of a module that is gone might be
+  /// reused by another one.
+  llvm::DenseMap<const llvm::Module *, std::string> pendingKeys;
+
+  /// The keys of the objects that this cache has seen so far
+  std::vector<std::string> keys;
+
+  std::string computeKey(const llvm::Module *m);
+};
+
+/// Wraps the compiler of an engine that uses `cache`, so the cache drops
+/// the pending key of a module that fails to compile.
+class SERENE_EXPORT ObjectCacheCompiler
+    : public llvm::orc::IRCompileLayer::IRCompiler {
+public:
+  ObjectCacheCompiler(
+      std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler> compiler,
+      ObjectCache &cache)
+      : IRCompiler(compiler->getManglingOptions()),
+        compiler(std::move(compiler)), cache(cache){};
+
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+  operator()(llvm::Module &m) override;
+
+private:
+  std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler> compiler;
+  ObjectCache &cache;
+};
+
+/// Create an object cache based on the given options. It returns a
+/// nullptr if the object cache is disabled.
+std::unique_ptr<ObjectCache> makeObjectCache(const Options &opts);
+
+} // namespace serene::jit
+
+#endif
@@ -16,16 +16,114 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/**
+ * Commentary:
+  There are two ABIs to call the JIT code from C++:
+
+  - The packed ABI: The wrapper of function `foo` is `__serene_foo(i8**)`
+    and it receives a list of pointers to the arguments and the result.
+    It works for any signature but every argument goes through two
+    memory indirections.
+  - The direct ABI: The wrapper of function `foo` is `__serene_d_foo` and
+    it has the same signature as `foo` with the C calling convention, so
+    the arguments get passed in registers. Only functions with up to
+    `Packer::maxDirectArgsCount` scalar or pointer arguments get a direct
+    wrapper.
+  - The batch ABI: The wrapper of function `foo` is
+    `__serene_b_foo(i8**, i64)` and it calls `foo` once per row of a
+    column oriented table of arguments in a loop. It receives a list of
+    pointers to the argument columns followed by a pointer to the result
+    column and the number of rows. Only functions with scalar or pointer
+    arguments and a scalar or pointer result get a batch wrapper.
+
+  `Packer` picks the ABI at compile time based on the C++ types of the
+  arguments and the result.
+
+  Host arrays, strings and buffers (`llvm::ArrayRef`, `llvm::StringRef`,
+  `std::span`, ...) are passed as `types::Slice` which is `{ptr, i64}` in
+  the generated code. The packed wrapper loads the slice and passes it by
+  value. The elements themselves are never copied.
+ */
+
 #ifndef SERENE_JIT_PACKER_H
 #define SERENE_JIT_PACKER_H
 
+#include "serene/export.h"
+#include "serene/types/types.h"
+
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/IR/Module.h>
 
+#include <cstdint>
+#include <type_traits>
+
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
 namespace serene::jit {
 
+/// Trait that defines the types that cross the boundary as a
+/// `types::Slice`. Only views qualify since the arguments are passed by
+/// value and copying containers would defeat the purpose.
+template <typename T>
+struct SliceArgument : std::false_type {};
+
+template <typename T>
+struct SliceArgument<llvm::ArrayRef<T>> : std::true_type {
+  static types::Slice toSlice(llvm::ArrayRef<T> val) {
+    return {val.data(), val.size()};
+  }
+};
+
+template <typename T>
+struct SliceArgument<llvm::MutableArrayRef<T>> : std::true_type {
+  static types::Slice toSlice(llvm::MutableArrayRef<T> val) {
+    return {val.data(), val.size()};
+  }
+};
+
+template <>
+struct SliceArgument<llvm::StringRef> : std::true_type {
+  static types::Slice toSlice(llvm::StringRef val) {
+    return {val.data(), val.size()};
+  }
+};
+
+#if __cplusplus >= 202002L
+template <typename T, size_t Extent>
+struct SliceArgument<std::span<T, Extent>> : std::true_type {
+  static types::Slice toSlice(std::span<T, Extent> val) {
+    return {val.data(), val.size()};
+  }
+};
+#endif
+
 struct Packer {
+  /// The maximum number of arguments of the functions that we call via the
+  /// direct ABI. It's the number of integer argument registers in the SysV
+  /// x86_64 calling convention.
+  static constexpr unsigned maxDirectArgsCount = 6;
+
+  /// Whether values of type `T` fit in a register, so they can be passed to
+  /// or returned from the JIT code directly.
+  template <typename T>
+  static constexpr bool isRegisterType =
+      std::is_scalar_v<T> && !std::is_member_pointer_v<T> &&
+      sizeof(T) <= sizeof(uint64_t);
+
+  /// Whether a function of type `Ret(Args...)` can be called via the direct
+  /// ABI or not.
+  template <typename Ret, typename... Args>
+  static constexpr bool useDirectABI =
+      sizeof...(Args) <= maxDirectArgsCount &&
+      // `void` is fine too. The conditional is there to avoid `sizeof(void)`
+      (std::is_void_v<Ret> ||
+       isRegisterType<std::conditional_t<std::is_void_v<Ret>, int, Ret>>) &&
+      (isRegisterType<Args> && ...);
+
   /// Trait that defines how a given type is passed to the JIT code. This
   /// defaults to passing the address but can be specialized.
   template <typename T>
@@ -57,10 +155,98 @@ struct Packer {
       args.push_back(&result.value);
     }
   };
+
+  /// Convert the arguments that cross the boundary as slices and leave the
+  /// rest as they are.
+  template <typename T>
+  static decltype(auto) lower(T &val) {
+    if constexpr (SliceArgument<T>::value) {
+      return SliceArgument<T>::toSlice(val);
+    } else {
+      return (val);
+    }
+  };
+
+  /// Pack the addresses of the given arguments and call `fn`. The lowered
+  /// slices are temporaries that live until the end of the call.
+  template <typename... Lowered>
+  static void packAndCall(void (*fn)(void **), Lowered &&...args) {
+    llvm::SmallVector<void *, sizeof...(Lowered)> packed;
+    (Argument<std::decay_t<Lowered>>::pack(packed, args), ...);
+    fn(packed.data());
+  };
+
+  /// Call the packed wrapper `fn` with the given `args` and store the
+  /// result in `result`.
+  template <typename Ret, typename... Args>
+  static void callPacked(void (*fn)(void **), FnResult<Ret> result,
+                         Args... args) {
+    packAndCall(fn, lower(args)..., result);
+  };
+
+  /// Call the packed wrapper `fn` of a function without a result.
+  template <typename... Args>
+  static void callPacked(void (*fn)(void **), Args... args) {
+    packAndCall(fn, lower(args)...);
+  };
+
+  /// Call the batch wrapper `fn` on the given `columns` of arguments and
+  /// store the results in `results`. All the columns must have the same
+  /// number of rows as `results`.
+  template <typename Ret, typename... Args>
+  static void callBatch(void *fn, llvm::MutableArrayRef<Ret> results,
+                        llvm::ArrayRef<Args>... columns) {
+    static_assert(isRegisterType<Ret> && (isRegisterType<Args> && ...),
+                  "This signature is not supported by the batch ABI");
+    void *packed[] = {const_cast<Args *>(columns.data())..., results.data()};
+    reinterpret_cast<void (*)(void **, uint64_t)>(fn)(packed, results.size());
+  };
+
+  /// Call the direct wrapper `fn` that has the type `Ret(Args...)`.
+  template <typename Ret, typename... Args>
+  static Ret callDirect(void *fn, Args... args) {
+    static_assert(useDirectABI<Ret, Args...>,
+                  "This signature is not supported by the direct ABI");
+    return reinterpret_cast<Ret (*)(Args...)>(fn)(args...);
+  };
 };
 
-std::string makePackedFunctionName(llvm::StringRef name);
-void packFunctionArguments(llvm::Module *module);
+SERENE_EXPORT std::string makePackedFunctionName(llvm::StringRef name);
+/// Return the type of `types::Slice` in the generated code, `{ptr, i64}`.
+SERENE_EXPORT llvm::StructType *getSliceType(llvm::LLVMContext &ctx);
+
+/// Define the packed wrapper of the function `func` in the given `module`.
+/// `func` might be just a declaration.
+SERENE_EXPORT llvm::Function *definePackedFunction(llvm::Module &module,
+                                                   llvm::Function &func);
+/// Define the packed wrappers of all the functions of the given `module`.
+/// It doubles the number of functions in the module, so prefer the lazy
+/// wrappers of the engine unless you need all of them.
+SERENE_EXPORT void packFunctionArguments(llvm::Module *module);
+
+SERENE_EXPORT std::string makeDirectFunctionName(llvm::StringRef name);
+/// Return a boolean indicating whether a function with the given type can
+/// be called via the direct ABI or not.
+SERENE_EXPORT bool isDirectlyCallable(const llvm::FunctionType &fnTy);
+/// Return a boolean indicating whether the given function `fn` can be
+/// called via the direct ABI or not.
+SERENE_EXPORT bool isDirectlyCallable(const llvm::Function &fn);
+/// Define the direct wrapper of the function `func` in the given `module`.
+/// `func` might be just a declaration but it has to be directly callable.
+SERENE_EXPORT llvm::Function *defineDirectFunction(llvm::Module &module,
+                                                   llvm::Function &func);
+/// Define the direct wrappers of all the directly callable functions in
+/// the given `module`.
+SERENE_EXPORT void defineDirectFunctions(llvm::Module *module);
+
+SERENE_EXPORT std::string makeBatchFunctionName(llvm::StringRef name);
+/// Return a boolean indicating whether a function with the given type can
+/// have a batch wrapper or not.
+SERENE_EXPORT bool isBatchCallable(const llvm::FunctionType &fnTy);
+/// Define the batch wrapper of the function `func` in the given `module`.
+/// `func` might be just a declaration but it has to be batch callable.
+SERENE_EXPORT llvm::Function *defineBatchFunction(llvm::Module &module,
+                                                  llvm::Function &func);
 
 } // namespace serene::jit
 #endif
@@ -0,0 +1,167 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Support for precise collection of the GC heap via LLVM statepoints. It's
+  experimental and internal. Nothing consumes the root maps yet, so the
+  engine only uses it if libserene is built with
+  `SERENE_EXPERIMENTAL_PRECISE_GC`.
+
+  In precise mode the pointers to the GC heap live in the address space
+  `gcAddressSpace` and every function gets the `statepoint-example` GC
+  strategy and frame pointers. The code generator marks every function
+  with `usePreciseGC` as it creates it, so the emitters of `values.h` and
+  `allocation.h` produce GC pointers in it. Then `rewriteStatepoints`
+  turns every call
+  into a statepoint, so the code generator spills the live GC pointers
+  around the calls and describes their stack slots in the
+  `.llvm_stackmaps` section of the object file.
+
+  `StackMapListener` feeds those sections to the process wide
+  `StackMapRegistry` as the objects get loaded. A runtime function that JIT
+  compiled code called can then walk the JIT frames on the stack with
+  `StackMapRegistry::visitRoots` and visit, or update, every live GC
+  pointer in them. That's what a moving collector needs. The walk stops at
+  the first frame that isn't JIT compiled, and the rest of the stack is
+  left to the conservative scanning of the collector.
+
+  Only x86-64 is supported for now.
+ */
+
+#ifndef SERENE_JIT_STATEPOINTS_H
+#define SERENE_JIT_STATEPOINTS_H
+
+#include "serene/export.h"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/STLFunctionalExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/Support/Error.h>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace llvm {
+class Function;
+class LLVMContext;
+class Module;
+class PointerType;
+} // namespace llvm
+
+namespace serene::jit {
+
+/// The GC strategy of the functions in precise mode
+constexpr const char *preciseGCStrategy = "statepoint-example";
+
+/// Only the pointers in this address space are GC pointers
+constexpr unsigned gcAddressSpace = 1;
+
+/// Return the type of the pointers to the GC heap in precise mode.
+SERENE_EXPORT llvm::PointerType *getGCPointerType(llvm::LLVMContext &ctx);
+
+/// Make `fn` use precise collection. The emitters produce GC pointers in
+/// the functions that use it.
+SERENE_EXPORT void usePreciseGC(llvm::Function &fn);
+
+/// Whether `fn` uses precise collection or not.
+SERENE_EXPORT bool usesPreciseGC(const llvm::Function &fn);
+
+/// Prepare the functions that are defined in `m` for precise collection
+/// and rewrite their calls into statepoints.
+SERENE_EXPORT void rewriteStatepoints(llvm::Module &m);
+
+/// Called with the stack slot of every live GC pointer, and the slot of
+/// the base object that the pointer points into. A moving collector has to
+/// update both.
+using RootVisitor = llvm::function_ref<void(void **base, void **derived)>;
+
+/// A thread safe map from the return addresses of the statepoints to the
+/// stack slots of the GC pointers that are live across them.
+class SERENE_EXPORT StackMapRegistry {
+public:
+  /// Register the call sites of the given `.llvm_stackmaps` section of the
+  /// object with the given `key`. The section must be loaded and
+  /// relocated already.
+  llvm::Error add(uint64_t key, llvm::ArrayRef<uint8_t> section);
+
+  /// Forget about the call sites of the object with the given `key`.
+  void remove(uint64_t key);
+
+  /// Visit the GC pointers in the JIT compiled frames on the stack of the
+  /// current thread. `framePointer` has to be the frame pointer of a
+  /// function that JIT compiled code called directly, e.g. the
+  /// `__builtin_frame_address(0)` of a runtime function.
+  void visitRoots(void *framePointer, RootVisitor visit) const;
+
+  /// Return the number of the known call sites.
+  size_t size() const;
+
+private:
+  struct Slot {
+    /// The DWARF number of the base register, either the stack pointer or
+    /// the frame pointer
+    uint16_t reg;
+    int32_t offset;
+  };
+
+  struct Root {
+    Slot base;
+    Slot derived;
+  };
+
+  struct CallSite {
+    llvm::SmallVector<Root, 4> roots;
+  };
+
+  mutable std::mutex lock;
+  /// Keyed by the return address of the statepoints
+  llvm::DenseMap<uint64_t, CallSite> callSites;
+  /// The return addresses that every object registered
+  llvm::DenseMap<uint64_t, std::vector<uint64_t>> objects;
+};
+
+/// Return the registry of the whole process. There is only one GC heap
+/// in the process, so there is only one set of roots too.
+SERENE_EXPORT StackMapRegistry &getStackMapRegistry();
+
+/// Registers the stack maps of the objects that the JIT loads in a
+/// `StackMapRegistry` and removes them when they are freed.
+class SERENE_EXPORT StackMapListener : public llvm::JITEventListener {
+  StackMapRegistry &registry;
+
+public:
+  explicit StackMapListener(StackMapRegistry &registry)
+      : registry(registry){};
+
+  void notifyObjectLoaded(ObjectKey key, const llvm::object::ObjectFile &obj,
+                          const llvm::RuntimeDyld::LoadedObjectInfo &info)
+      override;
+  void notifyFreeingObject(ObjectKey key) override;
+};
+
+/// Return the listener that feeds `getStackMapRegistry`. Like the other
+/// JIT event listeners, it lives as long as the process.
+SERENE_EXPORT llvm::JITEventListener *getStackMapListener();
+
+} // namespace serene::jit
+
+#endif
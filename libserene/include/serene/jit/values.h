@@ -0,0 +1,106 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Commentary:
+  Helpers to emit the operations on the tagged values (see
+  `serene/types/value.h`) in the generated code. Values are `i8*` in the
+  IR, or GC pointers in the functions that use precise collection (see
+  `serene/jit/statepoints.h`). The arithmetic checks the tags and the overflow inline and only
+  calls into `serene.core` when an argument is not a fixnum or the result
+  doesn't fit in one, e.g. for an addition:
+
+    %both  = and i64 %a, %b
+    %fix   = icmp ne i64 (and i64 %both, 1), 0
+    br i1 %fix, label %num.fixnum, label %num.slow
+  num.fixnum:
+    %r     = call { i64, i1 } @llvm.sadd.with.overflow.i64(%a, %b - 1)
+    br i1 %overflow, label %num.slow, label %num.cont   ; unlikely
+
+  So the common case is a handful of instructions, never allocates and
+  never calls anything.
+
+  The operations on atoms (see `serene/core/atom.h`) are atomic
+  instructions on the value of the atom, `swap!` is a `cmpxchg` loop
+  around the inlined update. They only call into `serene.core` to run
+  the watches of the atom, if it has any.
+ */
+
+#ifndef SERENE_JIT_VALUES_H
+#define SERENE_JIT_VALUES_H
+
+#include "serene/export.h"
+
+#include <llvm/IR/IRBuilder.h>
+
+#include <cstdint>
+
+namespace llvm {
+class Value;
+} // namespace llvm
+
+namespace serene::jit {
+
+/// The arithmetic with an inline fixnum fast path.
+enum class ArithmeticOp {
+  Add,
+  Subtract,
+  Multiply,
+};
+
+/// Emit the value of the given fixnum as a constant.
+SERENE_EXPORT llvm::Value *emitFixnum(llvm::IRBuilder<> &builder, int64_t i);
+
+/// Emit `a op b` on the integer values `a` and `b` at the insertion point
+/// of `builder` and return the result. The insertion block gets split and
+/// the builder points right after the operation when it returns.
+SERENE_EXPORT llvm::Value *emitArithmetic(llvm::IRBuilder<> &builder,
+                                          ArithmeticOp op, llvm::Value *a,
+                                          llvm::Value *b);
+
+/// Emits the new value of an atom from the current one, at the insertion
+/// point of the given builder. It can split the block.
+using AtomUpdate =
+    llvm::function_ref<llvm::Value *(llvm::IRBuilder<> &, llvm::Value *)>;
+
+/// Emit the current value of the atom `atom`.
+SERENE_EXPORT llvm::Value *emitAtomDeref(llvm::IRBuilder<> &builder,
+                                         llvm::Value *atom);
+
+/// Emit `(reset! atom v)` and return `v`.
+SERENE_EXPORT llvm::Value *emitAtomReset(llvm::IRBuilder<> &builder,
+                                         llvm::Value *atom, llvm::Value *v);
+
+/// Emit `(compare-and-set! atom oldValue newValue)` and return the `i1`
+/// result.
+SERENE_EXPORT llvm::Value *
+emitAtomCompareAndSet(llvm::IRBuilder<> &builder, llvm::Value *atom,
+                      llvm::Value *oldValue, llvm::Value *newValue);
+
+/// Emit `(swap! atom f)` where `update` emits `f` and return the new value.
+/// The update runs again if another thread changes the atom in the mean
+/// time. Like `emitArithmetic` the builder points right after the
+/// operation when it returns.
+SERENE_EXPORT llvm::Value *emitAtomSwap(llvm::IRBuilder<> &builder,
+                                        llvm::Value *atom,
+                                        AtomUpdate update);
+
+} // namespace serene::jit
+
+#endif
@@ -0,0 +1,108 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Hosts look up only a handful of entry points, so defining the wrappers
+  (see `Packer`) of every function eagerly is a waste of IR, codegen time
+  and symbol table space. Instead the engine records the signature of the
+  external functions of each module that it adds and `WrapperGenerator`
+  defines the wrapper of a function only when someone looks it up.
+
+  Internal functions never get a signature, hence never a wrapper.
+ */
+
+#ifndef SERENE_JIT_WRAPPER_GENERATOR_H
+#define SERENE_JIT_WRAPPER_GENERATOR_H
+
+#include "serene/export.h"
+
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ExecutionEngine/Orc/Core.h>
+#include <llvm/ExecutionEngine/Orc/Layer.h>
+#include <llvm/IR/CallingConv.h>
+#include <llvm/Support/Error.h>
+
+#include <mutex>
+#include <string>
+
+namespace llvm {
+class Module;
+} // namespace llvm
+
+namespace serene::jit {
+
+/// A thread safe map from the name of the functions to their signatures.
+/// Signatures are stored in the textual form of LLVM types since they
+/// have to outlive the `LLVMContext` of their modules.
+class SERENE_EXPORT SignatureRegistry {
+public:
+  struct Signature {
+    /// The function type, e.g `i64 (i64, ptr)`
+    std::string type;
+    llvm::CallingConv::ID callingConv;
+  };
+
+  /// Record the signatures of the external functions that are defined in
+  /// the module `m`.
+  void record(const llvm::Module &m);
+
+  llvm::Optional<Signature> get(llvm::StringRef fnName) const;
+
+private:
+  mutable std::mutex lock;
+  llvm::StringMap<Signature> signatures;
+};
+
+/// The different kinds of wrappers. See `Packer`.
+enum class WrapperKind { Packed, Direct, Batch };
+
+/// A definition generator that defines the packed, direct and batch
+/// wrappers of the functions in the `SignatureRegistry` on demand. It
+/// should be added to the `JITDylib` of every namespace.
+class WrapperGenerator : public llvm::orc::DefinitionGenerator {
+public:
+  WrapperGenerator(llvm::orc::IRLayer &layer,
+                   const SignatureRegistry &registry, char globalPrefix)
+      : layer(layer), registry(registry), globalPrefix(globalPrefix){};
+
+  llvm::Error
+  tryToGenerate(llvm::orc::LookupState &ls, llvm::orc::LookupKind k,
+                llvm::orc::JITDylib &jd,
+                llvm::orc::JITDylibLookupFlags jdLookupFlags,
+                const llvm::orc::SymbolLookupSet &lookupSet) override;
+
+private:
+  llvm::orc::IRLayer &layer;
+  const SignatureRegistry &registry;
+  /// The global prefix of the symbols on the target, e.g `_` on MachO
+  char globalPrefix;
+
+  /// Create a module that defines the wrapper `wrapperName` of the
+  /// function `fnName`. It returns `llvm::None` if we don't know the
+  /// function or it can't have such a wrapper.
+  llvm::Expected<llvm::Optional<llvm::orc::ThreadSafeModule>>
+  makeWrapperModule(llvm::StringRef wrapperName, llvm::StringRef fnName,
+                    WrapperKind kind) const;
+};
+
+} // namespace serene::jit
+
+#endif
@@ -21,6 +21,9 @@
 
 #include "serene/export.h"
 
+#include <cstdint>
+#include <string>
+
 namespace serene {
 /// Options describes the compiler options that can be passed to the
 /// compiler via command line. Anything that user should be able to
@@ -33,10 +36,58 @@ struct SERENE_EXPORT Options {
 
   // JIT related flags
   bool JITenableObjectCache              = true;
+  /// Whether to use the process wide object store, so engines in the same
+  /// process compile identical modules only once and share the objects.
+  bool JITshareObjectCache               = false;
+  /// Maximum number of bytes that the object cache may use in memory.
+  /// Zero means no limit.
+  uint64_t JITobjectCacheMaxMemory = 0;
+  /// The directory to persist the compiled objects in. An empty path keeps
+  /// the cache in memory only.
+  std::string JITobjectCacheDir;
+  /// Maximum number of bytes that the object cache may use on disk. Zero
+  /// means no limit.
+  uint64_t JITobjectCacheMaxDiskSize = 0;
+  /// Whether to compress the cached objects or not
+  bool JITcompressObjectCache = false;
   bool JITenableGDBNotificationListener  = true;
   bool JITenablePerfNotificationListener = true;
   bool JITLazy                           = false;
 
+  /// Whether to compile in deterministic mode or not. In this mode the
+  /// same namespace produces byte identical modules and objects across
+  /// runs and machines, so the object cache keys are stable.
+  bool deterministic = false;
+
+  /// Whether to load the prebuilt `serene.core` at the engine creation or
+  /// not. The prebuilt core is built along side of libserene.
+  bool usePrebuiltCore = true;
+  /// The directory to look for the prebuilt core in. An empty path means
+  /// the directory that contains libserene itself.
+  std::string prebuiltCoreDir;
+
+  // GC related flags. The collector is process wide, so these options
+  // apply to the whole process and the last engine that gets created
+  // wins. See `serene/gc.h`.
+  /// The initial size of the GC heap in bytes. Zero leaves it to the
+  /// collector.
+  uint64_t GCinitialHeapSize = 0;
+  /// Higher values collect more often and keep the heap smaller, lower
+  /// values use more memory and collect less often. Zero leaves it to
+  /// the collector (3 by default).
+  unsigned GCfreeSpaceDivisor = 0;
+  /// Number of the parallel marker threads, including the one that
+  /// starts the collection. Zero leaves it to the collector. It only
+  /// takes effect before the collector starts, so it has to be passed
+  /// to `SERENE_INIT_WITH_OPTIONS`.
+  unsigned GCmarkers = 0;
+  /// Whether to collect incrementally in small steps instead of stopping
+  /// the world for the whole collection
+  bool GCincremental = false;
+  /// The target of the maximum pause in milliseconds in incremental mode.
+  /// Zero leaves it to the collector.
+  unsigned long GCmaxPauseMs = 0;
+
   // namespace serene Options() = default;
 };
 } // namespace serene
@@ -19,14 +19,21 @@
 #ifndef SERENE_SERENE_H
 #define SERENE_SERENE_H
 #include "serene/export.h"     // for SERENE_EXPORT
+#include "serene/gc.h"         // for prepareGC
 #include "serene/jit/halley.h" // for Engine, MaybeEngine
 #include "serene/options.h"    // for Options
 
 #include <gc.h>
 
-#define SERENE_INIT() \
-  GC_INIT();          \
-  initSerene();
+/// Same as `SERENE_INIT` but configures the GC with the given options.
+/// Some of the GC options only take effect here. See `serene/gc.h`.
+#define SERENE_INIT_WITH_OPTIONS(opts) \
+  serene::prepareGC(opts);             \
+  GC_INIT();                           \
+  GC_allow_register_threads();         \
+  serene::initSerene();
+
+#define SERENE_INIT() SERENE_INIT_WITH_OPTIONS(serene::Options())
 
 namespace serene {
 
@@ -0,0 +1,265 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The binary encoding of forms that `types::Expression` points to. A form
+  is a flat sequence of bytes instead of a tree of nodes, so it can be
+  passed around as a single span, copied with a `memcpy` and traversed
+  without chasing pointers.
+
+  Every form starts with a tag byte:
+
+  - `0x80` to `0xff`: An integer between -64 and 63 that is stored in the
+    lower 7 bits of the tag itself. Most integers in the code are small.
+  - `Int`: A zigzag encoded varint follows.
+  - `Float`: 8 bytes of a little endian IEEE 754 double follow.
+  - `String`: The varint length and the bytes of the string follow.
+  - `Symbol`: The varint IDs of the namespace and the name follow. See
+    `types::Symbol`.
+  - `Keyword`: The varint ID of the name follows.
+  - `List` and `Vector`: The varint number of the elements, the varint
+    size of the elements in bytes and then the elements follow. Having the
+    size in front lets the readers skip a whole collection in O(1).
+  - `Nil`, `True` and `False`: Nothing follows.
+
+  Varints are LEB128. Locations are not part of the encoding. They belong
+  to a side table of the reader, keyed by the offset of the form.
+
+  `FormBuilder` encodes forms and `FormCursor` reads them in place. Cursors
+  are two pointers and never copy or allocate anything.
+ */
+
+#ifndef SERENE_TYPES_FORM_H
+#define SERENE_TYPES_FORM_H
+
+#include "serene/export.h"
+#include "serene/types/types.h"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/iterator.h>
+#include <llvm/Support/Error.h>
+
+#include <cassert>
+#include <cstdint>
+
+namespace serene::types {
+
+enum class FormTag : uint8_t {
+  Nil     = 0x00,
+  True    = 0x01,
+  False   = 0x02,
+  Int     = 0x03,
+  Float   = 0x04,
+  String  = 0x05,
+  Symbol  = 0x06,
+  Keyword = 0x07,
+  List    = 0x08,
+  Vector  = 0x09,
+
+  /// The first tag of the inline small integers
+  SmallInt = 0x80,
+};
+
+/// The kind of a form regardless of how it is encoded.
+enum class FormKind {
+  Nil,
+  Bool,
+  Int,
+  Float,
+  String,
+  Symbol,
+  Keyword,
+  List,
+  Vector,
+};
+
+/// The range of the integers that fit in the tag byte.
+constexpr int64_t minSmallInt = -64;
+constexpr int64_t maxSmallInt = 63;
+
+class FormIterator;
+
+/// A read only view to an encoded form. A cursor is only valid as long as
+/// the underlying bytes are.
+class SERENE_EXPORT FormCursor {
+  const unsigned char *pos;
+  const unsigned char *end;
+
+  FormTag tag() const {
+    assert(pos < end && "Reading past the end of the form");
+    auto t = *pos;
+    return t >= uint8_t(FormTag::SmallInt) ? FormTag::SmallInt : FormTag(t);
+  };
+
+public:
+  FormCursor(const unsigned char *pos, const unsigned char *end)
+      : pos(pos), end(end){};
+  explicit FormCursor(llvm::ArrayRef<unsigned char> bytes)
+      : FormCursor(bytes.begin(), bytes.end()){};
+  explicit FormCursor(const Expression &expr)
+      : FormCursor(expr.data, expr.data + expr.len){};
+
+  /// Make sure that the given bytes are a sequence of well formed forms
+  /// before reading them. Cursors assume that their input is well formed
+  /// and the builder always produces well formed forms, so only the bytes
+  /// from the outside world need to be verified.
+  static llvm::Error verify(llvm::ArrayRef<unsigned char> bytes);
+
+  FormKind getKind() const;
+
+  bool isNil() const { return tag() == FormTag::Nil; };
+
+  bool getBool() const;
+  int64_t getInt() const;
+  double getFloat() const;
+  llvm::StringRef getString() const;
+  Symbol getSymbol() const;
+  StringID getKeyword() const;
+
+  /// Return the number of the elements of a list or a vector.
+  uint64_t size() const;
+
+  /// Return the cursor to the first element of a list or a vector. The
+  /// elements are the forms from there up to the end of the collection.
+  FormCursor elementsBegin() const;
+  FormCursor elementsEnd() const;
+
+  /// Return a cursor to the form right after this one.
+  FormCursor next() const;
+
+  /// The bytes of this form, e.g. to copy it somewhere else.
+  llvm::ArrayRef<unsigned char> getBytes() const {
+    return {pos, next().pos};
+  };
+
+  bool atEnd() const { return pos == end; };
+
+  bool operator==(const FormCursor &other) const { return pos == other.pos; };
+  bool operator!=(const FormCursor &other) const { return pos != other.pos; };
+
+  /// Iterate over the elements of a list or a vector.
+  llvm::iterator_range<FormIterator> elements() const;
+};
+
+/// An iterator over the elements of a collection.
+class FormIterator
+    : public llvm::iterator_facade_base<FormIterator,
+                                        std::forward_iterator_tag, FormCursor> {
+  FormCursor current;
+
+public:
+  explicit FormIterator(FormCursor c) : current(c){};
+  const FormCursor &operator*() const { return current; };
+  FormIterator &operator++() {
+    current = current.next();
+    return *this;
+  };
+  bool operator==(const FormIterator &other) const {
+    return current == other.current;
+  };
+};
+
+inline llvm::iterator_range<FormIterator> FormCursor::elements() const {
+  return {FormIterator(elementsBegin()), FormIterator(elementsEnd())};
+};
+
+/// Encodes forms into a growing buffer. Collections are opened with
+/// `beginList` or `beginVector`, filled with the elements and closed with
+/// `end`. For example, `(def x 1)` is:
+/// \code
+/// FormBuilder b;
+/// b.beginList();
+/// b.addSymbol(def);
+/// b.addSymbol(x);
+/// b.addInt(1);
+/// b.end();
+/// \endcode
+///
+/// The header of a collection depends on its elements, so the headers are
+/// kept aside until the outermost collection ends and then get spliced in
+/// with a single pass over its bytes.
+class SERENE_EXPORT FormBuilder {
+  struct OpenCollection {
+    /// The offset of the first element in `buf`
+    size_t offset;
+    uint64_t count;
+    /// The index of the header of this collection in `headers`
+    size_t header;
+    /// The bytes of the headers of the nested collections that are not
+    /// in `buf` yet
+    size_t nestedHeaderBytes;
+  };
+
+  struct Header {
+    /// The offset in `buf` that the header goes to
+    size_t offset;
+    uint64_t count;
+    uint64_t size;
+  };
+
+  llvm::SmallVector<unsigned char, 256> buf;
+  llvm::SmallVector<OpenCollection, 8> open;
+  /// The headers of the collections of the current top level form in the
+  /// order of their offsets
+  llvm::SmallVector<Header, 8> headers;
+
+  void addTag(FormTag t);
+  void addVarint(uint64_t v);
+  void beginCollection(FormTag t);
+  void spliceHeaders(size_t extraBytes);
+
+public:
+  void addNil() { addTag(FormTag::Nil); };
+  void addBool(bool v) { addTag(v ? FormTag::True : FormTag::False); };
+  void addInt(int64_t v);
+  void addFloat(double v);
+  void addString(llvm::StringRef s);
+  void addSymbol(Symbol sym);
+  void addKeyword(StringID name);
+
+  void beginList() { beginCollection(FormTag::List); };
+  void beginVector() { beginCollection(FormTag::Vector); };
+  /// Close the innermost open collection.
+  void end();
+
+  /// Return the encoded forms so far. All the collections must be closed.
+  llvm::ArrayRef<unsigned char> getBytes() const {
+    assert(open.empty() && "There are unclosed collections");
+    return buf;
+  };
+
+  /// Return an expression that points to the buffer of this builder. It
+  /// is valid as long as the builder is alive and unchanged.
+  Expression getExpression() const {
+    auto bytes = getBytes();
+    return Expression(bytes.data(), bytes.size());
+  };
+
+  void clear() {
+    buf.clear();
+    open.clear();
+    headers.clear();
+  };
+};
+
+} // namespace serene::types
+
+#endif
@@ -0,0 +1,79 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  An `Interner` owns a set of unique strings and hands out a dense 32 bit
+  ID for each of them. IDs start from zero and never change or get reused
+  during the life time of the interner, so the tables that are keyed by
+  interned strings can be plain arrays indexed by the ID and comparing or
+  hashing an interned string is an integer operation.
+
+  The engine keeps one interner for the namespace names and another one
+  for the symbol names, so both ID spaces stay as dense as possible.
+ */
+
+#ifndef SERENE_TYPES_INTERNER_H
+#define SERENE_TYPES_INTERNER_H
+
+#include "serene/export.h"
+#include "serene/types/types.h"
+
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Allocator.h>
+
+#include <deque>
+#include <mutex>
+
+namespace serene::types {
+
+/// A thread safe string interner. See the commentary of this file.
+class SERENE_EXPORT Interner {
+public:
+  /// Return the ID of the given string `s` and intern it if it is new.
+  StringID intern(llvm::StringRef s);
+
+  /// Return the ID of the given string `s` if it is interned already.
+  llvm::Optional<StringID> find(llvm::StringRef s) const;
+
+  /// Return the interned string of the given `id`. The returned string is
+  /// NUL terminated and lives as long as the interner does.
+  const InternalString &get(StringID id) const;
+
+  llvm::StringRef getString(StringID id) const {
+    const auto &s = get(id);
+    return {s.data, s.len};
+  };
+
+  /// Return the number of interned strings which is also the next ID.
+  size_t size() const;
+
+private:
+  mutable std::mutex lock;
+  /// The keys of the map own the actual characters. Interned strings live
+  /// as long as the interner, so the entries go to a bump allocator.
+  llvm::StringMap<StringID, llvm::BumpPtrAllocator> ids;
+  /// Indexed by ID. A deque never moves its elements on `push_back`
+  std::deque<InternalString> strings;
+};
+
+} // namespace serene::types
+
+#endif
@@ -19,14 +19,25 @@
 #ifndef SERENE_TYPES_TYPE_H
 #define SERENE_TYPES_TYPE_H
 
+#include <llvm/ADT/DenseMapInfo.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
 namespace serene::types {
 
 // ============================================================================
 // Expression
 // ============================================================================
+
+/// A span of `len` bytes of encoded forms. See `serene/types/form.h` for
+/// the encoding and `FormCursor` to read them.
 struct Expression {
   const unsigned char *data;
-  explicit Expression(const unsigned char *data) : data(data){};
+  uint64_t len;
+
+  Expression(const unsigned char *data, uint64_t len) : data(data), len(len){};
 };
 
 // ============================================================================
@@ -44,26 +55,80 @@ struct InternalString {
       : data(data), len(len){};
 };
 
+/// The dense ID of a string in an `Interner`.
+using StringID = uint32_t;
+
 // ============================================================================
 // Symbol
 // ============================================================================
+
+/// A fully qualified symbol. `ns` is the ID of the namespace name and `name`
+/// is the ID of the symbol name, each in their own `Interner` of the engine
+/// (see `jit::Halley::makeSymbol`). So a symbol fits in a register and
+/// comparing or hashing it never touches the strings.
 struct Symbol {
-  const InternalString *ns;
-  const InternalString *name;
+  StringID ns;
+  StringID name;
+
+  Symbol(StringID ns, StringID name) : ns(ns), name(name){};
 
-  Symbol(const InternalString *ns, const InternalString *name)
-      : ns(ns), name(name){};
+  bool operator==(const Symbol &other) const {
+    return ns == other.ns && name == other.name;
+  };
+  bool operator!=(const Symbol &other) const { return !(*this == other); };
+
+  uint64_t toInt() const { return (uint64_t(ns) << 32) | name; };
 };
 
+static_assert(sizeof(Symbol) == 8, "Symbol has to fit in 8 bytes");
+
+// ============================================================================
+// Slice
+// ============================================================================
+
+/// A view to `len` elements of host memory starting at `ptr`. It's how
+/// arrays, strings and byte buffers cross the boundary between the host
+/// and the JIT code. The generated code sees it as `{ptr, i64}` (see
+/// `jit::getSliceType`). Neither side copies the elements or allocates GC
+/// memory for them, so the host has to keep the memory alive during the
+/// call.
+struct Slice {
+  const void *ptr;
+  uint64_t len;
+};
+
+static_assert(std::is_standard_layout_v<Slice> && offsetof(Slice, ptr) == 0 &&
+                  offsetof(Slice, len) == sizeof(void *) &&
+                  sizeof(Slice) == sizeof(void *) + sizeof(uint64_t),
+              "The layout of Slice has to match `{ptr, i64}`");
+
 // ============================================================================
 // Namespace
 // ============================================================================
 struct Namespace {
+  /// The ID of `name` in the namespace names interner of the engine
+  StringID id;
   const InternalString *name;
 
-  explicit Namespace(const InternalString *name) : name(name){};
+  Namespace(StringID id, const InternalString *name) : id(id), name(name){};
 };
 
 }; // namespace serene::types
 
+namespace llvm {
+/// Let symbols be the keys of `DenseMap`s and `DenseSet`s. The empty and
+/// tombstone keys are IDs that no interner would reach in practice.
+template <>
+struct DenseMapInfo<serene::types::Symbol> {
+  using Symbol = serene::types::Symbol;
+
+  static inline Symbol getEmptyKey() { return {~0U, ~0U}; };
+  static inline Symbol getTombstoneKey() { return {~0U - 1, ~0U - 1}; };
+  static unsigned getHashValue(const Symbol &sym) {
+    return DenseMapInfo<uint64_t>::getHashValue(sym.toInt());
+  };
+  static bool isEqual(const Symbol &a, const Symbol &b) { return a == b; };
+};
+} // namespace llvm
+
 #endif
@@ -0,0 +1,172 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  The representation of the runtime values. A value is a single 64 bit
+  word and the lowest 3 bits of it tell what it is:
+
+    ...xx1  A fixnum, a 63 bit signed integer in the upper bits
+    ...000  A pointer to a heap object, or nil if it's zero
+    ...010  Another immediate. Bits 3 to 7 tell which one:
+              0  A boolean, the value is in bit 8
+              1  A character, the Unicode code point is in the upper 32 bits
+
+  So the small integers, characters, booleans and nil never touch the
+  heap. Adding two fixnums is adding the words and fixing the tag, and an
+  overflow turns the result into a bignum (see `serene/core/number.h`).
+
+  Heap objects are pointers as they are, so the collector sees them
+  without any untagging. Every heap object that can be a value starts
+  with an `ObjectHeader` that tells its type.
+
+  The runtime in `serene.core` and the code generator share this file.
+ */
+
+#ifndef SERENE_TYPES_VALUE_H
+#define SERENE_TYPES_VALUE_H
+
+#include <cassert>
+#include <cstdint>
+
+namespace serene::types {
+
+/// A tagged runtime value. It's a pointer type, so the conservative
+/// collector treats the heap objects in it as pointers.
+using Value = void *;
+
+static_assert(sizeof(Value) == 8, "Values are 64 bit words");
+
+constexpr uintptr_t tagMask = 0x7;
+
+constexpr uintptr_t fixnumTag    = 0x1;
+constexpr uintptr_t objectTag    = 0x0;
+constexpr uintptr_t immediateTag = 0x2;
+
+constexpr unsigned immediateKindShift = 3;
+constexpr uintptr_t immediateKindMask = 0x1f;
+
+enum class ImmediateKind : uintptr_t {
+  Bool = 0,
+  Char = 1,
+};
+
+constexpr uintptr_t falseWord = immediateTag;
+constexpr uintptr_t trueWord  = immediateTag | (uintptr_t(1) << 8);
+constexpr uintptr_t charShift = 32;
+
+/// The range of the integers that fit in a fixnum
+constexpr int64_t maxFixnum = (int64_t(1) << 62) - 1;
+constexpr int64_t minFixnum = -(int64_t(1) << 62);
+
+enum class ObjectType : uint32_t {
+  Vector = 1,
+  HashMap,
+  HashSet,
+  String,
+  BigInt,
+  Seq,
+  Transducer,
+  Promise,
+  Atom,
+  Channel,
+};
+
+/// The first word of every heap object that can be a value.
+struct ObjectHeader {
+  ObjectType type;
+  /// Free for the object itself to use, so small objects don't need
+  /// another word for a small field
+  uint32_t aux;
+};
+
+static_assert(sizeof(ObjectHeader) == 8, "The header has to be one word");
+
+/// The offsets of the fields of an atom of `serene.core`, that the code
+/// generator reads and swaps in place (see `serene/core/atom.h`). The
+/// first one is the current value and the second one is the list of the
+/// watches, which is nil for an atom without any.
+constexpr unsigned atomValueOffset   = 8;
+constexpr unsigned atomWatchesOffset = 16;
+
+inline uintptr_t toWord(Value v) { return reinterpret_cast<uintptr_t>(v); };
+inline Value fromWord(uintptr_t w) { return reinterpret_cast<Value>(w); };
+
+inline bool isNil(Value v) { return v == nullptr; };
+inline bool isFixnum(Value v) { return (toWord(v) & fixnumTag) != 0; };
+inline bool isObject(Value v) {
+  return v != nullptr && (toWord(v) & tagMask) == objectTag;
+};
+
+inline bool isImmediateOf(Value v, ImmediateKind kind) {
+  auto w = toWord(v);
+  return (w & tagMask) == immediateTag &&
+         ((w >> immediateKindShift) & immediateKindMask) == uintptr_t(kind);
+};
+
+inline bool isBool(Value v) { return isImmediateOf(v, ImmediateKind::Bool); };
+inline bool isChar(Value v) { return isImmediateOf(v, ImmediateKind::Char); };
+
+/// Only nil and false are false
+inline bool isTruthy(Value v) {
+  return v != nullptr && toWord(v) != falseWord;
+};
+
+inline bool fitsFixnum(int64_t i) { return i >= minFixnum && i <= maxFixnum; };
+
+inline Value makeFixnum(int64_t i) {
+  assert(fitsFixnum(i) && "The integer doesn't fit in a fixnum");
+  return fromWord((static_cast<uintptr_t>(i) << 1) | fixnumTag);
+};
+
+inline int64_t getFixnum(Value v) {
+  assert(isFixnum(v) && "Not a fixnum");
+  // Arithmetic shift keeps the sign
+  return static_cast<int64_t>(toWord(v)) >> 1;
+};
+
+inline Value makeBool(bool b) { return fromWord(b ? trueWord : falseWord); };
+
+inline bool getBool(Value v) {
+  assert(isBool(v) && "Not a boolean");
+  return toWord(v) == trueWord;
+};
+
+inline Value makeChar(uint32_t codePoint) {
+  return fromWord((uintptr_t(codePoint) << charShift) |
+                  (uintptr_t(ImmediateKind::Char) << immediateKindShift) |
+                  immediateTag);
+};
+
+inline uint32_t getChar(Value v) {
+  assert(isChar(v) && "Not a character");
+  return static_cast<uint32_t>(toWord(v) >> charShift);
+};
+
+inline ObjectType getObjectType(Value v) {
+  assert(isObject(v) && "Not a heap object");
+  return static_cast<const ObjectHeader *>(v)->type;
+};
+
+inline bool isObjectOf(Value v, ObjectType type) {
+  return isObject(v) && getObjectType(v) == type;
+};
+
+} // namespace serene::types
+
+#endif
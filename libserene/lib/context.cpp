@@ -38,9 +38,10 @@ int SereneContext::getOptimizatioLevel() {
 
 void terminate(SereneContext &ctx, int exitCode) {
   (void)ctx;
-  // TODO: Since we are running in a single thread for now using exit is fine
-  // but we need to adjust and change it to a thread safe termination
-  // process later on.
+  // TODO: The workers of the scheduler of `serene.core` only run the code
+  // that the user spawns, so exiting under their feet is fine for now. But
+  // we need a thread safe termination process that drains them first
+  // later on.
   // NOLINTNEXTLINE(concurrency-mt-unsafe)
   std::exit(exitCode);
 }
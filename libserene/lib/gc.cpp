@@ -0,0 +1,169 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "serene/gc.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <gc.h>
+
+namespace serene {
+
+using Clock = std::chrono::steady_clock;
+
+// The collector calls `onCollectionEvent` while it holds its allocation
+// lock, so `pauseStart` is never accessed concurrently. The totals are
+// atomic since `getGCStats` reads them without the lock.
+static Clock::time_point pauseStart;
+static std::atomic<uint64_t> totalPauseUs{0};
+static std::atomic<uint64_t> maxPauseUs{0};
+
+static void GC_CALLBACK onCollectionEvent(GC_EventType event) {
+  switch (event) {
+  case GC_EVENT_PRE_STOP_WORLD:
+    pauseStart = Clock::now();
+    break;
+
+  case GC_EVENT_POST_START_WORLD: {
+    auto pause = std::chrono::duration_cast<std::chrono::microseconds>(
+                     Clock::now() - pauseStart)
+                     .count();
+    totalPauseUs += pause;
+    if (static_cast<uint64_t>(pause) > maxPauseUs) {
+      maxPauseUs = pause;
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+};
+
+void prepareGC(const Options &opts) {
+  if (opts.GCmarkers != 0) {
+    GC_set_markers_count(opts.GCmarkers);
+  }
+
+  GC_set_on_collection_event(onCollectionEvent);
+};
+
+void configureGC(const Options &opts) {
+  if (opts.GCfreeSpaceDivisor != 0) {
+    GC_set_free_space_divisor(opts.GCfreeSpaceDivisor);
+  }
+
+  if (opts.GCmaxPauseMs != 0) {
+    GC_set_time_limit(opts.GCmaxPauseMs);
+  }
+
+  // There is no way back from the incremental mode
+  if (opts.GCincremental) {
+    GC_enable_incremental();
+  }
+
+  auto heapSize = GC_get_heap_size();
+  if (heapSize < opts.GCinitialHeapSize) {
+    GC_expand_hp(opts.GCinitialHeapSize - heapSize);
+  }
+};
+
+GCStats getGCStats() {
+  struct GC_prof_stats_s prof;
+  GC_get_prof_stats(&prof, sizeof(prof));
+
+  GCStats stats;
+  stats.heapSize         = prof.heapsize_full;
+  stats.freeBytes        = prof.free_bytes_full;
+  stats.bytesSinceLastGC = prof.bytes_allocd_since_gc;
+  stats.gcCount          = prof.gc_no;
+  stats.totalPauseTime   = std::chrono::microseconds(totalPauseUs.load());
+  stats.maxPauseTime     = std::chrono::microseconds(maxPauseUs.load());
+  return stats;
+};
+
+namespace {
+/// Frees the free lists of a thread when it exits. The objects in them
+/// become garbage afterwards.
+struct ThreadAllocationBuffers {
+  AllocationBuffers *buffers = nullptr;
+
+  ~ThreadAllocationBuffers() {
+    if (buffers != nullptr) {
+      GC_FREE(buffers);
+    }
+  };
+};
+} // namespace
+
+static thread_local ThreadAllocationBuffers threadBuffers;
+
+AllocationBuffers *serene_alloc_buffers() {
+  if (threadBuffers.buffers == nullptr) {
+    // Uncollectable memory is a root for the collector, so the objects
+    // in the free lists stay alive until someone allocates them
+    threadBuffers.buffers = static_cast<AllocationBuffers *>(
+        GC_MALLOC_UNCOLLECTABLE(sizeof(AllocationBuffers)));
+  }
+
+  return threadBuffers.buffers;
+};
+
+void *serene_alloc_slow(AllocationBuffers *buffers, uint64_t granules) {
+  assert(granules > 0 && granules <= maxInlineAllocationGranules &&
+         "Not an inline size class");
+
+  auto *list = GC_malloc_many(granules * allocationGranule);
+  if (list == nullptr) {
+    return nullptr;
+  }
+
+  buffers->freeLists[granules] = GC_NEXT(list);
+  GC_NEXT(list)                = nullptr;
+  return list;
+};
+
+void *allocateLarge(size_t size) { return GC_MALLOC(size); };
+
+void *allocateUncollectable(size_t size) {
+  return GC_MALLOC_UNCOLLECTABLE(size);
+};
+
+void freeUncollectable(void *p) { GC_FREE(p); };
+
+void registerGCThread() {
+  struct GC_stack_base base;
+  auto res = GC_get_stack_base(&base);
+  assert(res == GC_SUCCESS && "Can't find the stack of the thread");
+  (void)res;
+
+  // It's fine for a thread to be registered already, e.g. the main one
+  GC_register_my_thread(&base);
+};
+
+void unregisterGCThread() {
+  // The free lists have to go before the thread is gone for the collector
+  if (threadBuffers.buffers != nullptr) {
+    GC_FREE(threadBuffers.buffers);
+    threadBuffers.buffers = nullptr;
+  }
+  GC_unregister_my_thread();
+};
+
+} // namespace serene
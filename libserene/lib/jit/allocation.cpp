@@ -0,0 +1,101 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "serene/jit/allocation.h"
+
+#include "./ir_utils.h"
+
+#include "serene/config.h"
+#include "serene/gc.h"
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+
+#include <cassert>
+
+namespace serene::jit {
+
+llvm::Value *emitGetAllocationBuffers(llvm::IRBuilder<> &builder) {
+  auto &module = getModule(builder);
+  auto fn      = module.getOrInsertFunction(
+      ALLOC_BUFFERS_FUNCTION_NAME,
+      llvm::FunctionType::get(builder.getInt8PtrTy(), /*isVarArg=*/false));
+
+  return builder.CreateCall(fn, {}, "alloc.buffers");
+};
+
+llvm::Value *emitAllocation(llvm::IRBuilder<> &builder, llvm::Value *buffers,
+                            uint64_t size) {
+  auto &module  = getModule(builder);
+  auto &ctx     = builder.getContext();
+  auto *i8PtrTy = builder.getInt8PtrTy();
+  auto *i64Ty   = builder.getInt64Ty();
+  // The free lists hold objects, so they are values as well
+  auto *valueTy = getValueType(builder);
+  auto granules = (size + allocationGranule - 1) / allocationGranule;
+
+  if (granules == 0 || granules > maxInlineAllocationGranules) {
+    auto gcMalloc = module.getOrInsertFunction(
+        GC_MALLOC_FUNCTION_NAME,
+        llvm::FunctionType::get(valueTy, {i64Ty}, /*isVarArg=*/false));
+    return builder.CreateCall(gcMalloc, {builder.getInt64(size)}, "obj");
+  }
+
+  auto slowPath = module.getOrInsertFunction(
+      ALLOC_SLOW_PATH_FUNCTION_NAME,
+      llvm::FunctionType::get(valueTy, {i8PtrTy, i64Ty}, /*isVarArg=*/false));
+
+  auto *fn   = builder.GetInsertBlock()->getParent();
+  auto *cont = splitAtInsertPoint(builder, "alloc.cont");
+  auto *fast = llvm::BasicBlock::Create(ctx, "alloc.fast", fn, cont);
+  auto *slow = llvm::BasicBlock::Create(ctx, "alloc.slow", fn, cont);
+
+  auto *freeLists = builder.CreateBitCast(buffers, valueTy->getPointerTo());
+  auto *slot      = builder.CreateGEP(valueTy, freeLists,
+                                      builder.getInt64(granules), "alloc.slot");
+  auto *head = builder.CreateLoad(valueTy, slot, "alloc.head");
+  auto *isEmpty =
+      builder.CreateICmpEQ(head, llvm::ConstantPointerNull::get(valueTy));
+  // The free lists hold many objects, so the slow path is rare
+  builder.CreateCondBr(isEmpty, slow, fast,
+                       llvm::MDBuilder(ctx).createBranchWeights(1, 1 << 20));
+
+  // Pop the head of the free list and clear its link
+  builder.SetInsertPoint(fast);
+  auto *link = builder.CreateBitCast(
+      head, valueTy->getPointerTo(valueTy->getAddressSpace()));
+  builder.CreateStore(builder.CreateLoad(valueTy, link, "alloc.next"), slot);
+  builder.CreateStore(llvm::ConstantPointerNull::get(valueTy), link);
+  builder.CreateBr(cont);
+
+  builder.SetInsertPoint(slow);
+  auto *refilled =
+      builder.CreateCall(slowPath, {buffers, builder.getInt64(granules)});
+  refilled->addFnAttr(llvm::Attribute::Cold);
+  builder.CreateBr(cont);
+
+  builder.SetInsertPoint(cont, cont->begin());
+  auto *obj = builder.CreatePHI(valueTy, 2, "obj");
+  obj->addIncoming(head, fast);
+  obj->addIncoming(refilled, slow);
+  return obj;
+};
+
+} // namespace serene::jit
@@ -0,0 +1,379 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "serene/jit/determinism.h"
+
+#include "serene/config.h"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h> // for isDigit
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace serene::jit {
+
+static bool isAnonymousFunction(const llvm::Function &fn) {
+  return fn.hasLocalLinkage() &&
+         fn.getName().startswith(ANONYMOUS_FUNCTION_PREFIX);
+};
+
+static bool isIdentifierChar(char c) {
+  return llvm::isAlnum(c) || c == '_' || c == '.';
+};
+
+/// The name that an anonymous function has until it gets its final name.
+/// It never collides with a final name.
+static std::string pendingName(size_t i) {
+  return (llvm::Twine(ANONYMOUS_FUNCTION_PREFIX) + "pending." + llvm::Twine(i))
+      .str();
+};
+
+/// Call `fn` with every name in the textual IR `text` that starts with
+/// `ANONYMOUS_FUNCTION_PREFIX`.
+template <typename Fn>
+static void forEachAnonymousName(llvm::StringRef text, Fn fn) {
+  const llvm::StringRef prefix(ANONYMOUS_FUNCTION_PREFIX);
+
+  for (auto pos = text.find(prefix); pos != llvm::StringRef::npos;
+       pos = text.find(prefix)) {
+    text      = text.drop_front(pos);
+    auto name = text.take_while(isIdentifierChar);
+    fn(name);
+    text = text.drop_front(name.size());
+  }
+};
+
+/// Mask everything in the textual IR `text` of a function that depends on
+/// the rest of the module rather than the function itself. Those are the
+/// anonymous functions in `pending`, which don't have their final names
+/// yet, and the module wide numbering of the attribute groups (`#N`) and
+/// metadata nodes (`!N`).
+static std::string maskModuleDependentParts(llvm::StringRef text,
+                                            const llvm::StringSet<> &pending) {
+  const llvm::StringRef prefix(ANONYMOUS_FUNCTION_PREFIX);
+  std::string result;
+  result.reserve(text.size());
+
+  while (!text.empty()) {
+    if (text.startswith(prefix)) {
+      auto name = text.take_while(isIdentifierChar);
+      if (pending.contains(name)) {
+        result.append(prefix.begin(), prefix.end());
+        result.push_back('_');
+      } else {
+        result.append(name.begin(), name.end());
+      }
+      text = text.drop_front(name.size());
+      continue;
+    }
+
+    char c = text.front();
+    result.push_back(c);
+    text = text.drop_front();
+
+    if ((c == '#' || c == '!') && !text.empty() &&
+        llvm::isDigit(text.front())) {
+      result.push_back('_');
+      text = text.drop_while(llvm::isDigit);
+    }
+  }
+
+  return result;
+};
+
+static std::string printFunction(llvm::Function &fn) {
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  fn.print(os);
+  // Since the attribute groups are masked in the body, we add the
+  // function attributes themselves to the hash
+  os << fn.getAttributes().getFnAttrs().getAsString();
+  os.flush();
+  return text;
+};
+
+/// Return a hash of the given function `fn` that is independent of the
+/// name of `fn` and the names of the anonymous functions in `pending`.
+static uint64_t hashFunction(llvm::Function &fn,
+                             const llvm::StringSet<> &pending) {
+  return llvm::xxHash64(maskModuleDependentParts(printFunction(fn), pending));
+};
+
+namespace {
+struct AnonymousFunction {
+  llvm::Function *fn;
+  /// The other anonymous functions that `fn` refers to
+  llvm::SmallVector<AnonymousFunction *, 4> callees;
+  bool named = false;
+};
+} // namespace
+
+/// Return the anonymous functions that are not named yet and are
+/// reachable from `from` through other ones that are not named yet.
+static std::vector<AnonymousFunction *> reachable(AnonymousFunction &from) {
+  std::vector<AnonymousFunction *> result{&from};
+  llvm::SmallPtrSet<AnonymousFunction *, 8> visited{&from};
+
+  for (size_t i = 0; i < result.size(); i++) {
+    for (auto *callee : result[i]->callees) {
+      if (!callee->named && visited.insert(callee).second) {
+        result.push_back(callee);
+      }
+    }
+  }
+
+  return result;
+};
+
+/// Return the members of a cycle of anonymous functions that doesn't call
+/// any other function that is not named yet. Every function that reaches
+/// the fewest functions is in such a cycle, and it reaches exactly the
+/// members of its cycle.
+static std::vector<AnonymousFunction *>
+findBottomCycle(std::vector<AnonymousFunction> &anonFns) {
+  auto start = llvm::find_if(
+      anonFns, [](const AnonymousFunction &f) { return !f.named; });
+  assert(start != anonFns.end() && "There is no function left to name");
+
+  std::vector<AnonymousFunction *> best;
+  for (auto *anonFn : reachable(*start)) {
+    auto cycle = reachable(*anonFn);
+    if (best.empty() || cycle.size() < best.size()) {
+      best = std::move(cycle);
+    }
+  }
+
+  return best;
+};
+
+static uint64_t hashValues(llvm::ArrayRef<uint64_t> values) {
+  return llvm::xxHash64(
+      llvm::StringRef(reinterpret_cast<const char *>(values.data()),
+                      values.size() * sizeof(uint64_t)));
+};
+
+/// Name the members of the given `cycle` of mutually recursive anonymous
+/// functions by calling `name` with the hash of each one. The hashes only
+/// depend on the contents of the cycle and not on the order of the module.
+///
+/// The members can't be named after each other, so we start with their
+/// hashes without the names of the other members and refine them, round
+/// by round, with the hashes of the members that they refer to in the
+/// order of the references. That is a partition refinement, and once the
+/// number of distinct hashes stops growing, two members have the same hash
+/// only if they behave the same, so merging them is fine. At the end, every
+/// hash gets combined with the hash of the sorted hashes of the whole cycle
+/// to tell apart the members of cycles that only differ somewhere else.
+template <typename NameFn>
+static void nameCycle(const std::vector<AnonymousFunction *> &cycle,
+                      const llvm::StringSet<> &pending, NameFn name) {
+  llvm::DenseMap<llvm::Function *, size_t> index;
+  for (size_t i = 0; i < cycle.size(); i++) {
+    index[cycle[i]->fn] = i;
+  }
+
+  std::vector<uint64_t> hashes;
+  std::vector<std::vector<size_t>> refs(cycle.size());
+
+  for (size_t i = 0; i < cycle.size(); i++) {
+    auto &fn = *cycle[i]->fn;
+    hashes.push_back(hashFunction(fn, pending));
+
+    auto *m = fn.getParent();
+    forEachAnonymousName(printFunction(fn), [&](llvm::StringRef ref) {
+      auto it = index.find(m->getFunction(ref));
+      if (it != index.end()) {
+        refs[i].push_back(it->second);
+      }
+    });
+  }
+
+  auto countDistinct = [](std::vector<uint64_t> values) {
+    llvm::sort(values);
+    return std::unique(values.begin(), values.end()) - values.begin();
+  };
+
+  for (auto distinct = countDistinct(hashes);;) {
+    std::vector<uint64_t> refined;
+    for (size_t i = 0; i < cycle.size(); i++) {
+      llvm::SmallVector<uint64_t, 8> values{hashes[i]};
+      for (auto ref : refs[i]) {
+        values.push_back(hashes[ref]);
+      }
+      refined.push_back(hashValues(values));
+    }
+
+    hashes = std::move(refined);
+
+    auto refinedDistinct = countDistinct(hashes);
+    if (refinedDistinct == distinct) {
+      break;
+    }
+    distinct = refinedDistinct;
+  }
+
+  auto sorted = hashes;
+  llvm::sort(sorted);
+  auto cycleHash = hashValues(sorted);
+
+  for (size_t i = 0; i < cycle.size(); i++) {
+    name(*cycle[i], hashValues({cycleHash, hashes[i]}));
+  }
+};
+
+static void renameAnonymousFunctions(llvm::Module &m) {
+  std::vector<AnonymousFunction> anonFns;
+
+  for (auto &fn : m) {
+    if (isAnonymousFunction(fn)) {
+      anonFns.push_back({&fn, {}});
+    }
+  }
+
+  if (anonFns.empty()) {
+    return;
+  }
+
+  // Move the current names out of the way first, so the new names never
+  // collide with the old ones and LLVM doesn't have to unique them.
+  llvm::StringMap<AnonymousFunction *> byName;
+  llvm::StringSet<> pending;
+
+  for (size_t i = 0; i < anonFns.size(); i++) {
+    anonFns[i].fn->setName(pendingName(i));
+    byName[anonFns[i].fn->getName()] = &anonFns[i];
+    pending.insert(anonFns[i].fn->getName());
+  }
+
+  for (auto &anonFn : anonFns) {
+    forEachAnonymousName(printFunction(*anonFn.fn), [&](llvm::StringRef name) {
+      auto it = byName.find(name);
+      if (it != byName.end() && it->second != &anonFn &&
+          llvm::find(anonFn.callees, it->second) == anonFn.callees.end()) {
+        anonFn.callees.push_back(it->second);
+      }
+    });
+  }
+
+  // A function gets its name after the functions that it calls, and its
+  // hash covers their final names. So two functions that only differ in
+  // the anonymous functions that they call never end up with the same
+  // hash. Identical functions are interchangeable, so we keep the first
+  // one and merge the rest into it. Only the callers can tell which one
+  // survived and the survivor has the same name either way. When only
+  // mutually recursive functions and their callers are left, we name one
+  // of the cycles that the others depend on as a whole and carry on.
+  llvm::DenseMap<uint64_t, llvm::Function *> named;
+  std::vector<AnonymousFunction *> ready;
+  size_t left = anonFns.size();
+
+  auto name = [&](AnonymousFunction &anonFn, uint64_t hash) {
+    pending.erase(anonFn.fn->getName());
+    anonFn.named = true;
+    left--;
+
+    auto &existing = named[hash];
+    if (existing != nullptr) {
+      anonFn.fn->replaceAllUsesWith(existing);
+      anonFn.fn->eraseFromParent();
+      anonFn.fn = existing;
+      return;
+    }
+
+    existing = anonFn.fn;
+    anonFn.fn->setName(llvm::formatv("{0}{1:x-16}", ANONYMOUS_FUNCTION_PREFIX,
+                                     hash)
+                           .str());
+  };
+
+  while (left != 0) {
+    ready.clear();
+    for (auto &anonFn : anonFns) {
+      if (!anonFn.named &&
+          llvm::all_of(anonFn.callees, [](const AnonymousFunction *callee) {
+            return callee->named;
+          })) {
+        ready.push_back(&anonFn);
+      }
+    }
+
+    if (ready.empty()) {
+      nameCycle(findBottomCycle(anonFns), pending, name);
+      continue;
+    }
+
+    // None of the functions in a round calls another one of the same
+    // round, so they can be hashed first and named afterwards.
+    std::vector<uint64_t> hashes;
+    for (auto *anonFn : ready) {
+      hashes.push_back(hashFunction(*anonFn->fn, pending));
+    }
+    for (size_t i = 0; i < ready.size(); i++) {
+      name(*ready[i], hashes[i]);
+    }
+  }
+};
+
+template <typename T>
+static void sortByName(llvm::SymbolTableList<T> &list) {
+  std::vector<T *> items;
+  items.reserve(list.size());
+
+  for (auto &item : list) {
+    items.push_back(&item);
+  }
+
+  std::stable_sort(items.begin(), items.end(), [](T *a, T *b) {
+    return a->getName() < b->getName();
+  });
+
+  // Splicing within the same list keeps the symbol table untouched
+  for (auto *item : items) {
+    list.splice(list.end(), list, item->getIterator());
+  }
+};
+
+void makeModuleDeterministic(llvm::Module &m, llvm::StringRef name) {
+  m.setModuleIdentifier(name);
+  m.setSourceFileName(name);
+
+  renameAnonymousFunctions(m);
+
+  sortByName(m.getFunctionList());
+  sortByName(m.getGlobalList());
+};
+
+} // namespace serene::jit
@@ -18,13 +18,18 @@
 
 #include "serene/jit/halley.h"
 
+#include "serene/config.h"
 #include "serene/context.h" // for Seren...
 #include "serene/fs.h"
+#include "serene/jit/determinism.h"
+#include "serene/jit/statepoints.h"
 #include "serene/options.h"     // for Options
 #include "serene/types/types.h" // for Names...
 
 #include <system_error> // for error...
 
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/ScopeExit.h>
 #include <llvm/ADT/StringMapEntry.h> // for Strin...
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/Triple.h>   // for Triple
@@ -48,30 +53,38 @@
 #include <llvm/IR/LLVMContext.h>                               // for LLVMC...
 #include <llvm/IR/Module.h>                                    // for Module
 #include <llvm/IRReader/IRReader.h>
+#include <llvm/Object/ObjectFile.h>
 #include <llvm/Support/CodeGen.h> // for Level
 #include <llvm/Support/Error.h>
 #include <llvm/Support/FileSystem.h>     // for OF_None
 #include <llvm/Support/FormatVariadic.h> // for formatv
 #include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
 #include <llvm/Support/SourceMgr.h>
-#include <llvm/Support/ToolOutputFile.h> // for ToolO...
+#include <llvm/Support/ThreadPool.h>
 #include <llvm/Support/raw_ostream.h>    // for raw_o...
 
 #include <algorithm> // for max
 #include <assert.h>  // for assert
 #include <cerrno>
-#include <cstring>
-#include <gc.h>
+#include <chrono>
+#include <dlfcn.h>
 #include <memory>  // for uniqu...
 #include <string>  // for opera...
 #include <utility> // for move
 
-#define COMMON_ARGS_COUNT 8
-
 namespace serene {
 
 namespace jit {
 
+/// Whether to compile the code for precise collection or not. It's for
+/// the development of the collector only, see `serene/jit/statepoints.h`.
+#ifdef SERENE_EXPERIMENTAL_PRECISE_GC
+constexpr bool preciseGC = true;
+#else
+constexpr bool preciseGC = false;
+#endif
+
 // TODO: [error] Replace this function when we implemented
 // the error subsystem with the official implementation
 llvm::Error tempError(SereneContext &ctx, llvm::Twine s) {
@@ -82,86 +95,54 @@ llvm::Error tempError(SereneContext &ctx, llvm::Twine s) {
 };
 // /TODO
 
-void ObjectCache::notifyObjectCompiled(const llvm::Module *m,
-                                       llvm::MemoryBufferRef objBuffer) {
-  cachedObjects[m->getModuleIdentifier()] =
-      llvm::MemoryBuffer::getMemBufferCopy(objBuffer.getBuffer(),
-                                           objBuffer.getBufferIdentifier());
-}
-
-std::unique_ptr<llvm::MemoryBuffer>
-ObjectCache::getObject(const llvm::Module *m) {
-  auto i = cachedObjects.find(m->getModuleIdentifier());
+llvm::orc::JITDylib *Halley::getLatestJITDylib(const types::Namespace &ns) {
+  return getLatestJITDylib(ns.id);
+};
 
-  if (i == cachedObjects.end()) {
-    HALLEY_LOG("No object for " + m->getModuleIdentifier() +
-               " in cache. Compiling.");
+llvm::orc::JITDylib *Halley::getLatestJITDylib(const char *nsName) {
+  auto id = nsNames.find(nsName);
+  if (!id) {
     return nullptr;
   }
 
-  HALLEY_LOG("Object for " + m->getModuleIdentifier() + " loaded from cache.");
-  return llvm::MemoryBuffer::getMemBuffer(i->second->getMemBufferRef());
-}
-
-void ObjectCache::dumpToObjectFile(llvm::StringRef outputFilename) {
-  // Set up the output file.
-  std::error_code error;
-
-  auto file = std::make_unique<llvm::ToolOutputFile>(outputFilename, error,
-                                                     llvm::sys::fs::OF_None);
-  if (error) {
-
-    llvm::errs() << "cannot open output file '" + outputFilename.str() +
-                        "': " + error.message()
-                 << "\n";
-    return;
-  }
-  // Dump the object generated for a single module to the output file.
-  // TODO: Replace this with a runtime check
-  assert(cachedObjects.size() == 1 && "Expected only one object entry.");
-
-  auto &cachedObject = cachedObjects.begin()->second;
-  file->os() << cachedObject->getBuffer();
-  file->keep();
-}
-
-llvm::orc::JITDylib *Halley::getLatestJITDylib(const types::Namespace &ns) {
-  return getLatestJITDylib(ns.name->data);
+  return getLatestJITDylib(*id);
 };
 
-llvm::orc::JITDylib *Halley::getLatestJITDylib(const char *nsName) {
-  if (jitDylibs.count(nsName) == 0) {
+DylibPtr Halley::getLatestJITDylib(types::StringID nsID) const {
+  std::lock_guard<std::mutex> guard(tablesLock);
+
+  if (nsID >= jitDylibs.size() || jitDylibs[nsID].empty()) {
     return nullptr;
   }
 
-  auto vec = jitDylibs[nsName];
   // TODO: Make sure that the returning Dylib still exists in the JIT
   //       by calling jit->engine->getJITDylibByName(dylib_name);
-  return vec.empty() ? nullptr : vec.back();
+  return jitDylibs[nsID].back();
 };
 
 void Halley::pushJITDylib(types::Namespace &ns, llvm::orc::JITDylib *l) {
-  if (jitDylibs.count(ns.name->data) == 0) {
-    llvm::SmallVector<llvm::orc::JITDylib *, 1> vec{l};
-    jitDylibs[ns.name->data] = vec;
-    return;
+  std::lock_guard<std::mutex> guard(tablesLock);
+
+  if (ns.id >= jitDylibs.size()) {
+    jitDylibs.resize(ns.id + 1);
   }
-  auto vec = jitDylibs[ns.name->data];
-  vec.push_back(l);
-  jitDylibs[ns.name->data] = vec;
+
+  jitDylibs[ns.id].push_back(l);
 }
 
 size_t Halley::getNumberOfJITDylibs(types::Namespace &ns) {
-  if (jitDylibs.count(ns.name->data) == 0) {
+  std::lock_guard<std::mutex> guard(tablesLock);
+
+  if (ns.id >= jitDylibs.size()) {
     return 0;
   }
 
-  return jitDylibs[ns.name->data].size();
+  return jitDylibs[ns.id].size();
 };
 
 Halley::Halley(std::unique_ptr<SereneContext> ctx,
                llvm::orc::JITTargetMachineBuilder &&jtmb, llvm::DataLayout &&dl)
-    : cache(ctx->opts.JITenableObjectCache ? new ObjectCache() : nullptr),
+    : cache(makeObjectCache(ctx->opts)),
       gdbListener(ctx->opts.JITenableGDBNotificationListener
 
                       ? llvm::JITEventListener::createGDBRegistrationListener()
@@ -169,6 +150,7 @@ Halley::Halley(std::unique_ptr<SereneContext> ctx,
       perfListener(ctx->opts.JITenablePerfNotificationListener
                        ? llvm::JITEventListener::createPerfJITEventListener()
                        : nullptr),
+      stackMapListener(preciseGC ? getStackMapListener() : nullptr),
       jtmb(jtmb), dl(dl), ctx(std::move(ctx)){};
 
 // MaybeJITPtr Halley::lookup(exprs::Symbol &sym) const {
@@ -232,6 +214,20 @@ void Halley::dumpToObjectFile(llvm::StringRef filename) {
   cache->dumpToObjectFile(filename);
 };
 
+void Halley::trimObjectCache() {
+  if (cache) {
+    cache->getStore().trim();
+  }
+};
+
+llvm::Optional<ObjectStoreStats> Halley::getObjectCacheStats() const {
+  if (!cache) {
+    return llvm::None;
+  }
+
+  return cache->getStore().getStats();
+};
+
 MaybeEngine Halley::make(std::unique_ptr<SereneContext> sereneCtxPtr,
                          llvm::orc::JITTargetMachineBuilder &&jtmb) {
   auto dl = jtmb.getDefaultDataLayoutForTarget();
@@ -275,6 +271,9 @@ MaybeEngine Halley::make(std::unique_ptr<SereneContext> sereneCtxPtr,
     if (jitEngine->perfListener != nullptr) {
       objectLayer->registerJITEventListener(*jitEngine->perfListener);
     }
+    if (jitEngine->stackMapListener != nullptr) {
+      objectLayer->registerJITEventListener(*jitEngine->stackMapListener);
+    }
 
     // COFF format binaries (Windows) need special handling to deal with
     // exported symbol visibility.
@@ -298,13 +297,29 @@ MaybeEngine Halley::make(std::unique_ptr<SereneContext> sereneCtxPtr,
 
     JTMB.setCodeGenOptLevel(jitCodeGenOptLevel);
 
+    if (jitEngine->cache) {
+      // Anything that changes the generated code has to be part of the
+      // cache keys, otherwise engines with different settings that share
+      // the same object store would use each others objects.
+      jitEngine->cache->setCodeGenSettings(
+          llvm::formatv("{0};{1};{2};O{3}", JTMB.getTargetTriple().str(),
+                        JTMB.getCPU(), JTMB.getFeatures().getString(),
+                        static_cast<int>(jitCodeGenOptLevel))
+              .str());
+    }
+
     auto targetMachine = JTMB.createTargetMachine();
     if (!targetMachine) {
       return targetMachine.takeError();
     }
 
-    return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(
+    auto compiler = std::make_unique<llvm::orc::TMOwningSimpleCompiler>(
         std::move(*targetMachine), jitEngine->cache.get());
+    if (!jitEngine->cache) {
+      return compiler;
+    }
+    return std::make_unique<ObjectCacheCompiler>(std::move(compiler),
+                                                 *jitEngine->cache);
   };
 
   // TODO: [jit] This is not a proper way to handle both engines.
@@ -345,49 +360,77 @@ MaybeEngine Halley::make(std::unique_ptr<SereneContext> sereneCtxPtr,
         });
       });
 
+  if (sereneCtx.opts.deterministic || preciseGC) {
+    // Every IR module goes through the transform layer before reaching the
+    // compile layer and the object cache, so this is the right place to
+    // normalize them and to prepare them for precise collection.
+    jitEngine->engine->getIRTransformLayer().setTransform(
+        [deterministic = sereneCtx.opts.deterministic](
+            llvm::orc::ThreadSafeModule tsm,
+            llvm::orc::MaterializationResponsibility &r)
+            -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+          // JITDylibs are named `<ns>#<n>` and `n` is just the number of
+          // times that we loaded the namespace.
+          auto nsName =
+              llvm::StringRef(r.getTargetJITDylib().getName()).split('#').first;
+
+          tsm.withModuleDo([&](llvm::Module &m) {
+            if (deterministic) {
+              makeModuleDeterministic(m, nsName);
+            }
+            if (preciseGC) {
+              rewriteStatepoints(m);
+            }
+          });
+          return tsm;
+        });
+  }
+
   if (auto err = jitEngine->createCurrentProcessJD()) {
     return err;
   }
 
+  if (sereneCtx.opts.usePrebuiltCore) {
+    if (auto err = jitEngine->loadPrebuiltCore()) {
+      return err;
+    }
+  }
+
   return MaybeEngine(std::move(jitEngine));
 };
 
 const types::InternalString &Halley::getInternalString(const char *s) {
-  // TODO: [serene.core] We need to provide some functions on llvm level to
-  // build instances from these type in a functional way. We need to avoid
-  // randomly build instances here and there that causes unsafe memory
   assert(s && "s is nullptr: getInternalString");
-  auto len = std::strlen(s);
-
-  auto *str =
-      (types::InternalString *)GC_MALLOC_ATOMIC(sizeof(types::InternalString));
-
-  str->data = (char *)GC_MALLOC_ATOMIC(len);
-  memcpy((void *)str->data, (void *)s, len);
-  str->len = len;
+  return symbolNames.get(symbolNames.intern(s));
+};
 
-  stringStorage.push_back(str);
-  return *str;
-  // /TODO
+types::Symbol Halley::makeSymbol(llvm::StringRef nsName,
+                                 llvm::StringRef name) {
+  return {nsNames.intern(nsName), symbolNames.intern(name)};
 };
 
 types::Namespace &Halley::makeNamespace(const char *name) {
-  // TODO: [serene.core] We need to provide some functions on llvm level to
-  // build instances from these type in a functional way. We need to avoid
-  // randomly build instances here and there that causes unsafe memory
   assert(name && "name is nullptr: createNamespace");
-  const auto &nsName = getInternalString(name);
-  auto *ns           = (types::Namespace *)GC_MALLOC(sizeof(types::Namespace));
-  ns->name           = &nsName;
+  auto id = nsNames.intern(name);
+
+  std::lock_guard<std::mutex> guard(tablesLock);
+  if (id < nsStorage.size() && nsStorage[id] != nullptr) {
+    return *nsStorage[id];
+  }
+
+  if (id >= nsStorage.size()) {
+    nsStorage.resize(id + 1, nullptr);
+  }
 
-  nsStorage.push_back(ns);
+  // No JIT code can reach the namespace objects, so they don't belong to
+  // the GC heap
+  auto *ns      = sessionArena.make<types::Namespace>(id, &nsNames.get(id));
+  nsStorage[id] = ns;
   return *ns;
-  // /TODO
 };
 
 llvm::Error Halley::createEmptyNS(const char *name) {
   assert(name && "name is nullptr: createEmptyNS");
-  // TODO: Look up the Namespace first.
   auto &ns         = makeNamespace(name);
   auto numOfDylibs = getNumberOfJITDylibs(ns) + 1;
 
@@ -398,16 +441,25 @@ llvm::Error Halley::createEmptyNS(const char *name) {
       llvm::formatv("{0}#{1}", ns.name->data, numOfDylibs));
 
   if (!newDylib) {
-    llvm::errs() << "Couldn't create the jitDylib\n";
-    serene::terminate(*ctx, 1);
+    return newDylib.takeError();
   }
 
+  // The wrappers of the functions of this namespace get defined on demand
+  newDylib->addGenerator(std::make_unique<WrapperGenerator>(
+      engine->getIRTransformLayer(), signatures,
+      engine->getDataLayout().getGlobalPrefix()));
+
   pushJITDylib(ns, &(*newDylib));
   return llvm::Error::success();
 };
 
 MaybeJitAddress Halley::lookup(const types::Symbol &sym) const {
-  return lookup(sym.ns->data, sym.name->data);
+  auto addr = lookupWrapper(sym, WrapperKind::Packed);
+  if (!addr) {
+    return addr.takeError();
+  }
+
+  return reinterpret_cast<JitWrappedAddress>(*addr);
 }
 
 MaybeJitAddress Halley::lookup(const char *nsName, const char *sym) const {
@@ -417,17 +469,68 @@ MaybeJitAddress Halley::lookup(const char *nsName, const char *sym) const {
   llvm::StringRef s{sym};
   llvm::StringRef ns{nsName};
 
-  std::string fqsym = (ns + "/" + s).str();
+  auto addr = lookupFunction(ns, (ns + "/" + s).str(), WrapperKind::Packed);
+  if (!addr) {
+    return addr.takeError();
+  }
+
+  return reinterpret_cast<JitWrappedAddress>(*addr);
+};
+
+llvm::Expected<void *> Halley::lookupWrapper(const types::Symbol &name,
+                                             WrapperKind kind) const {
+  auto ns = getNamespaceName(name);
+  return lookupFunction(ns, (ns + "/" + getSymbolName(name)).str(), kind);
+};
+
+llvm::Expected<void *> Halley::lookupFunction(llvm::StringRef ns,
+                                              const std::string &fqsym,
+                                              WrapperKind kind) const {
+  // We only know the signatures of the functions that we added as IR.
+  // Object files and libraries bring their own symbols, so we hand out
+  // what they define under the plain name.
+  if (kind != WrapperKind::Batch && !signatures.get(fqsym)) {
+    return lookupAddress(ns, fqsym);
+  }
+
+  // The wrapper gets generated on the first lookup
+  switch (kind) {
+  case WrapperKind::Packed:
+    return lookupAddress(ns, makePackedFunctionName(fqsym));
+  case WrapperKind::Direct:
+    return lookupAddress(ns, makeDirectFunctionName(fqsym));
+  case WrapperKind::Batch:
+    return lookupAddress(ns, makeBatchFunctionName(fqsym));
+  }
+  llvm_unreachable("Unknown wrapper kind");
+};
+
+llvm::Error Halley::checkBatchShape(size_t rows,
+                                    llvm::ArrayRef<size_t> columnRows) const {
+  for (const auto &indexed : llvm::enumerate(columnRows)) {
+    if (indexed.value() != rows) {
+      return tempError(*ctx, llvm::formatv("Column {0} has {1} rows instead "
+                                           "of {2}",
+                                           indexed.index(), indexed.value(),
+                                           rows));
+    }
+  }
+
+  return llvm::Error::success();
+};
 
-  HALLEY_LOG("Looking up symbol: " << fqsym);
-  auto *dylib = const_cast<Halley *>(this)->jitDylibs[nsName].back();
+llvm::Expected<void *> Halley::lookupAddress(llvm::StringRef nsName,
+                                             llvm::StringRef symName) const {
+  HALLEY_LOG("Looking up symbol: " << symName);
+  auto nsID   = nsNames.find(nsName);
+  auto *dylib = nsID ? getLatestJITDylib(*nsID) : nullptr;
 
   if (dylib == nullptr) {
-    return tempError(*ctx, "No dylib " + s);
+    return tempError(*ctx, "No dylib " + nsName);
   }
 
   HALLEY_LOG("Looking in dylib: " << (void *)dylib);
-  auto expectedSymbol = engine->lookup(*dylib, fqsym);
+  auto expectedSymbol = engine->lookup(*dylib, symName);
 
   // JIT lookup may return an Error referring to strings stored internally by
   // the JIT. If the Error outlives the ExecutionEngine, it would want have a
@@ -439,14 +542,14 @@ MaybeJitAddress Halley::lookup(const char *nsName, const char *sym) const {
     return expectedSymbol.takeError();
   }
 
-  auto fptr = expectedSymbol->toPtr<JitWrappedAddress>();
+  auto *ptr = expectedSymbol->toPtr<void *>();
 
-  if (fptr == nullptr) {
+  if (ptr == nullptr) {
     return tempError(*ctx, "Lookup function is null!");
   }
 
-  HALLEY_LOG("Found symbol '" << fqsym << "' at " << (void *)fptr);
-  return fptr;
+  HALLEY_LOG("Found symbol '" << symName << "' at " << ptr);
+  return ptr;
 };
 
 // TODO: Remove this function before prod release
@@ -457,7 +560,10 @@ llvm::Error Halley::loadModule(const char *nsName, const char *file) {
   auto llvmContext = ctx->genLLVMContext();
   llvm::SMDiagnostic error;
 
-  auto *dylib = jitDylibs[nsName].back();
+  auto *dylib = getLatestJITDylib(nsName);
+  if (dylib == nullptr) {
+    return tempError(*ctx, llvm::Twine("No dylib ") + nsName);
+  }
 
   auto module = llvm::parseIRFile(file, error, *llvmContext);
 
@@ -467,6 +573,10 @@ llvm::Error Halley::loadModule(const char *nsName, const char *file) {
         error.getMessage().str() + " File: " + file);
   }
 
+  // We have to know the signatures before anyone looks up the wrappers
+  // and that might happen before the module gets materialized
+  signatures.record(*module);
+
   auto tsm =
       llvm::orc::ThreadSafeModule(std::move(module), std::move(llvmContext));
 
@@ -665,6 +775,501 @@ MaybeDylibPtr Halley::loadNamespace(std::string &nsName) {
   return tempError(*ctx, "Can't find namespace: " + nsName);
 };
 
+bool Halley::isNamespaceLoaded(llvm::StringRef nsName) {
+  auto id = nsNames.find(nsName);
+  return id && getLatestJITDylib(*id) != nullptr;
+};
+
+Halley::NSLoadState Halley::claimNamespace(llvm::StringRef nsName) {
+  auto id = nsNames.find(nsName);
+
+  // A namespace gets its `JITDylib` before it is fully loaded, so we
+  // check whether someone is loading it first
+  std::lock_guard<std::mutex> guard(tablesLock);
+  if (loadingNamespaces.contains(nsName)) {
+    return NSLoadState::Loading;
+  }
+
+  if (id && *id < jitDylibs.size() && !jitDylibs[*id].empty()) {
+    return NSLoadState::Loaded;
+  }
+
+  loadingNamespaces.insert(nsName);
+  return NSLoadState::Claimed;
+};
+
+void Halley::releaseNamespaces(llvm::ArrayRef<llvm::StringRef> nsNames) {
+  if (nsNames.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(tablesLock);
+    for (const auto &nsName : nsNames) {
+      loadingNamespaces.erase(nsName);
+    }
+  }
+
+  loadingDone.notify_all();
+};
+
+void Halley::waitForNamespaces(std::vector<llvm::StringRef> &nsNames,
+                               std::vector<llvm::StringRef> &done) {
+  done.clear();
+  std::unique_lock<std::mutex> guard(tablesLock);
+
+  loadingDone.wait(guard, [&]() {
+    auto it = std::stable_partition(
+        nsNames.begin(), nsNames.end(), [&](llvm::StringRef nsName) {
+          return loadingNamespaces.contains(nsName);
+        });
+    done.insert(done.end(), it, nsNames.end());
+    nsNames.erase(it, nsNames.end());
+    return !done.empty();
+  });
+};
+
+/// Read the list of namespaces that the object file in `file` depends on
+/// from its `NS_DEPENDENCIES_SECTION`. Object files without that section
+/// have no dependencies.
+static llvm::Expected<std::vector<std::string>>
+readNamespaceDependencies(llvm::StringRef file) {
+  std::vector<std::string> deps;
+
+  auto obj = llvm::object::ObjectFile::createObjectFile(file);
+  if (!obj) {
+    return obj.takeError();
+  }
+
+  for (const auto &section : obj->getBinary()->sections()) {
+    auto name = section.getName();
+    if (!name) {
+      return name.takeError();
+    }
+
+    if (*name != NS_DEPENDENCIES_SECTION) {
+      continue;
+    }
+
+    auto contents = section.getContents();
+    if (!contents) {
+      return contents.takeError();
+    }
+
+    llvm::SmallVector<llvm::StringRef, 8> names;
+    contents->split(names, '\0', -1, /*KeepEmpty=*/false);
+
+    for (auto &dep : names) {
+      deps.push_back(dep.str());
+    }
+  }
+
+  return deps;
+};
+
+llvm::Expected<Halley::NSLocation>
+Halley::locateNamespace(llvm::StringRef nsName) {
+  if (ctx->getLoadPaths().empty()) {
+    return tempError(*ctx, "Load paths should not be empty");
+  }
+
+  auto nsFileName = fs::namespaceToPath(nsName);
+
+  // TODO: [jit] Locate the other namespace file types as soon as we
+  // have a loader for them. For now object files are the only type of
+  // namespace files that carry the dependency metadata.
+  for (auto &path : ctx->getLoadPaths()) {
+    auto file = fs::join(path, nsFileName + ".o");
+
+    if (!fs::exists(file)) {
+      continue;
+    }
+
+    auto deps = readNamespaceDependencies(file);
+    if (!deps) {
+      return deps.takeError();
+    }
+
+    return NSLocation{nsName.str(), path, nsFileName, std::move(*deps)};
+  }
+
+  return tempError(*ctx, "Can't find namespace: " + nsName);
+};
+
+MaybeDylibPtr Halley::loadLocatedNamespace(NSLocation &loc) {
+  NSLoadRequest req{loc.nsName, loc.path, loc.nsToFileName};
+
+  auto maybeJD = loadNamespaceFrom<fs::NSFileType::ObjectFile>(req);
+  if (!maybeJD) {
+    return maybeJD.takeError();
+  }
+
+  auto *jd = *maybeJD;
+  if (jd == nullptr) {
+    return tempError(*ctx, "Can't load namespace: " + loc.nsName);
+  }
+
+  // The namespace itself is already the first entry in its link order
+  // then we want its dependencies in the order that they are listed and
+  // the main process last.
+  for (auto &dep : loc.deps) {
+    auto *depJD = getLatestJITDylib(dep.c_str());
+    if (depJD == nullptr) {
+      return tempError(*ctx, "Dependency '" + dep + "' of '" + loc.nsName +
+                                 "' is not loaded");
+    }
+    jd->addToLinkOrder(*depJD);
+  }
+
+  auto *processJD =
+      engine->getExecutionSession().getJITDylibByName(MAIN_PROCESS_JD_NAME);
+
+  if (processJD == nullptr) {
+    return tempError(*ctx, "Can't find the main process JD");
+  }
+
+  jd->addToLinkOrder(*processJD);
+  return jd;
+};
+
+/// Return the directory that contains libserene. It's where we install
+/// the prebuilt core.
+static std::string getLibSereneDir() {
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void *>(&getLibSereneDir), &info) == 0 ||
+      info.dli_fname == nullptr) {
+    return "";
+  }
+
+  llvm::SmallString<MAX_PATH_SLOTS> path;
+  if (llvm::sys::fs::real_path(info.dli_fname, path)) {
+    return "";
+  }
+
+  return llvm::sys::path::parent_path(path).str();
+};
+
+llvm::Error Halley::loadPrebuiltCore() {
+  auto start = std::chrono::steady_clock::now();
+
+  auto dir = ctx->opts.prebuiltCoreDir.empty() ? getLibSereneDir()
+                                               : ctx->opts.prebuiltCoreDir;
+  auto nsFileName = fs::namespaceToPath(CORE_NS_NAME);
+  auto manifestFile = fs::join(dir, nsFileName + PREBUILT_CORE_MANIFEST_EXT);
+  auto objFile = fs::join(dir, nsFileName + ".o");
+
+  if (dir.empty() || !fs::exists(manifestFile) || !fs::exists(objFile)) {
+    HALLEY_LOG("No prebuilt core in: " << dir);
+    return llvm::Error::success();
+  }
+
+  auto buf =
+      llvm::errorOrToExpected(llvm::MemoryBuffer::getFile(manifestFile));
+  if (!buf) {
+    return buf.takeError();
+  }
+
+  // The manifest is a list of `key=value` lines that the build system
+  // generates along side of the core object.
+  NSLocation loc{CORE_NS_NAME, dir, nsFileName, {}};
+  llvm::StringRef version;
+  llvm::StringRef triple;
+  uint64_t size = 0;
+
+  // namespace, version, triple, size and deps
+  llvm::SmallVector<llvm::StringRef, 5> lines;
+  (*buf)->getBuffer().split(lines, '\n', -1, /*KeepEmpty=*/false);
+
+  for (auto line : lines) {
+    auto kv = line.trim().split('=');
+    if (kv.first == "version") {
+      version = kv.second;
+    } else if (kv.first == "triple") {
+      triple = kv.second;
+    } else if (kv.first == "size") {
+      if (kv.second.getAsInteger(10, size)) {
+        return tempError(*ctx, "Invalid size in: " + manifestFile);
+      }
+    } else if (kv.first == "deps") {
+      llvm::SmallVector<llvm::StringRef, 4> deps;
+      kv.second.split(deps, ',', -1, /*KeepEmpty=*/false);
+
+      for (auto dep : deps) {
+        loc.deps.push_back(dep.str());
+      }
+    }
+  }
+
+  // A stale or foreign core is not an error, we just ignore it and let
+  // `require` load `serene.core` from the load paths.
+  uint64_t objSize = 0;
+  if (version != SERENE_VERSION ||
+      llvm::Triple(triple).normalize() != ctx->triple.normalize() ||
+      llvm::sys::fs::file_size(objFile, objSize) || objSize != size) {
+    HALLEY_LOG("Ignoring the prebuilt core in: " << dir);
+    return llvm::Error::success();
+  }
+
+  for (auto &dep : loc.deps) {
+    if (!isNamespaceLoaded(dep)) {
+      HALLEY_LOG("Dependency '" << dep << "' of the prebuilt core is missing");
+      return llvm::Error::success();
+    }
+  }
+
+  auto jd = loadLocatedNamespace(loc);
+  if (!jd) {
+    return jd.takeError();
+  }
+
+  HALLEY_LOG("Loaded the prebuilt core from '"
+             << objFile << "' in "
+             << std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count()
+             << "us");
+  return llvm::Error::success();
+};
+
+MaybeDylibPtr Halley::require(llvm::StringRef nsName) {
+  auto jds = require(llvm::makeArrayRef(nsName));
+  if (!jds) {
+    return jds.takeError();
+  }
+
+  return jds->front();
+};
+
+MaybeDylibPtrs Halley::require(llvm::ArrayRef<llvm::StringRef> nsNames) {
+  // The dependency graph of the namespaces that are not loaded yet.
+  // Namespaces that are already loaded are not part of the graph and
+  // count as satisfied dependencies. The ones that other `require` calls
+  // are loading are in `loadedElsewhere`. They are part of the graph so
+  // we can find the circular dependencies through them too, but we wait
+  // for them instead of loading them.
+  llvm::StringMap<NSLocation> graph;
+  llvm::StringSet<> loadedElsewhere;
+  std::vector<llvm::StringRef> claimed;
+  std::vector<std::string> frontier;
+
+  // Other `require` calls must never wait for the namespaces that we
+  // claimed but didn't get to load
+  auto releaseClaims =
+      llvm::make_scope_exit([&]() { releaseNamespaces(claimed); });
+
+  auto latestJITDylibs = [&]() {
+    std::vector<DylibPtr> jds;
+    for (const auto &nsName : nsNames) {
+      jds.push_back(getLatestJITDylib(nsName.str().c_str()));
+    }
+    return jds;
+  };
+
+  auto addToGraph = [&](llvm::StringRef nsName,
+                        std::vector<std::string> &to) {
+    if (graph.count(nsName) != 0) {
+      return;
+    }
+
+    auto state = claimNamespace(nsName);
+    if (state == NSLoadState::Loaded) {
+      return;
+    }
+
+    // The keys of a `StringMap` don't move, so we can refer to them
+    auto &entry = *graph.try_emplace(nsName).first;
+    if (state == NSLoadState::Claimed) {
+      claimed.push_back(entry.first());
+    } else {
+      loadedElsewhere.insert(nsName);
+    }
+    to.push_back(nsName.str());
+  };
+
+  for (const auto &nsName : nsNames) {
+    addToGraph(nsName, frontier);
+  }
+
+  // Everything is loaded already. Returning here also means that `err`
+  // below is always checked before it goes away.
+  if (graph.empty()) {
+    return latestJITDylibs();
+  }
+
+  llvm::ThreadPool pool;
+  std::mutex errLock;
+  llvm::Error err = llvm::Error::success();
+
+  auto collectError = [&](llvm::Error e) {
+    std::lock_guard<std::mutex> guard(errLock);
+    err = llvm::joinErrors(std::move(err), std::move(e));
+  };
+
+  // Discover the transitive dependencies one layer at a time. Reading
+  // the object files of a layer is independent from each other so we
+  // do it in parallel.
+  while (!frontier.empty()) {
+    for (auto &nsName : frontier) {
+      auto &slot = graph[nsName];
+      pool.async([&, nsName]() {
+        auto loc = locateNamespace(nsName);
+        if (!loc) {
+          collectError(loc.takeError());
+          return;
+        }
+        // The graph is not mutated during this phase, so writing to
+        // an existing slot is safe.
+        slot = std::move(*loc);
+      });
+    }
+    pool.wait();
+
+    if (err) {
+      return err;
+    }
+
+    std::vector<std::string> next;
+    for (auto &nsName : frontier) {
+      for (auto &dep : graph[nsName].deps) {
+        addToGraph(dep, next);
+      }
+    }
+    frontier.swap(next);
+  }
+
+  // Kahn's algorithm, each layer contains the namespaces that all of
+  // their dependencies are loaded by the previous layers.
+  llvm::StringMap<size_t> pendingDeps;
+  llvm::StringMap<std::vector<llvm::StringRef>> dependents;
+
+  for (auto &entry : graph) {
+    size_t count = 0;
+    for (auto &dep : entry.second.deps) {
+      if (graph.count(dep) != 0) {
+        dependents[dep].push_back(entry.first());
+        count++;
+      }
+    }
+    pendingDeps[entry.first()] = count;
+  }
+
+  // Sort the whole graph before loading anything. Otherwise, we might end
+  // up waiting for a namespace in a cycle that another `require` call
+  // never gets to load since it waits for us.
+  {
+    auto counts = pendingDeps;
+    size_t sorted = 0;
+    std::vector<llvm::StringRef> layer;
+
+    for (auto &entry : counts) {
+      if (entry.second == 0) {
+        layer.push_back(entry.first());
+      }
+    }
+
+    while (!layer.empty()) {
+      sorted += layer.size();
+
+      std::vector<llvm::StringRef> next;
+      for (auto &nsName : layer) {
+        for (auto &dependent : dependents[nsName]) {
+          if (--counts[dependent] == 0) {
+            next.push_back(dependent);
+          }
+        }
+      }
+      layer.swap(next);
+    }
+
+    if (sorted != graph.size()) {
+      std::string cycle;
+      for (auto &entry : counts) {
+        if (entry.second != 0) {
+          cycle += " " + entry.first().str();
+        }
+      }
+      return tempError(*ctx,
+                       "Circular dependency between namespaces:" + cycle);
+    }
+  }
+
+  // Load the namespaces whose dependencies are loaded in parallel. When
+  // none of ours is ready, the rest depend on the namespaces that other
+  // `require` calls are loading and we wait for them. Since the graph has
+  // no cycles, one of the `require` calls can always make progress.
+  std::vector<llvm::StringRef> ready;
+  std::vector<llvm::StringRef> waiting;
+  std::vector<llvm::StringRef> done;
+
+  for (auto &entry : loadedElsewhere) {
+    waiting.push_back(entry.first());
+  }
+
+  for (auto &entry : pendingDeps) {
+    if (entry.second == 0 && loadedElsewhere.count(entry.first()) == 0) {
+      ready.push_back(entry.first());
+    }
+  }
+
+  auto finish = [&](llvm::StringRef nsName) {
+    for (auto &dependent : dependents[nsName]) {
+      if (--pendingDeps[dependent] == 0 &&
+          loadedElsewhere.count(dependent) == 0) {
+        ready.push_back(dependent);
+      }
+    }
+  };
+
+  size_t left = graph.size();
+  while (left != 0) {
+    if (ready.empty()) {
+      assert(!waiting.empty() && "Nothing to load and nothing to wait for");
+      waitForNamespaces(waiting, done);
+
+      for (auto &nsName : done) {
+        if (!isNamespaceLoaded(nsName)) {
+          return tempError(*ctx, "Can't load namespace: " + nsName);
+        }
+        finish(nsName);
+      }
+      left -= done.size();
+      continue;
+    }
+
+    std::vector<llvm::StringRef> layer;
+    layer.swap(ready);
+
+    for (auto &nsName : layer) {
+      auto &loc = graph[nsName];
+      pool.async([&]() {
+        HALLEY_LOG("Requiring namespace: " << loc.nsName);
+        auto jd = loadLocatedNamespace(loc);
+        if (!jd) {
+          collectError(jd.takeError());
+        }
+      });
+    }
+    pool.wait();
+
+    // Loaded or not, the others don't have to wait for them anymore
+    releaseNamespaces(layer);
+    llvm::erase_if(claimed, [&](llvm::StringRef nsName) {
+      return llvm::is_contained(layer, nsName);
+    });
+
+    if (err) {
+      return err;
+    }
+
+    left -= layer.size();
+    for (auto &nsName : layer) {
+      finish(nsName);
+    }
+  }
+
+  return latestJITDylibs();
+};
+
 MaybeDylibPtr Halley::loadStaticLibrary(const std::string &name) {
   if (ctx->getLoadPaths().empty()) {
     return tempError(*ctx, "Load paths should not be empty");
@@ -0,0 +1,85 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Private helpers for the code that emits inline fast paths into the
+  functions of the generated code.
+ */
+
+#ifndef SERENE_JIT_IR_UTILS_H
+#define SERENE_JIT_IR_UTILS_H
+
+#include "serene/jit/statepoints.h"
+
+#include <llvm/ADT/Twine.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+
+#include <cassert>
+
+namespace serene::jit {
+
+inline llvm::Module &getModule(llvm::IRBuilder<> &builder) {
+  auto *bb = builder.GetInsertBlock();
+  assert(bb && bb->getParent() && "The builder has no insertion point");
+  return *bb->getParent()->getParent();
+};
+
+/// Return the type of the values in the function that `builder` emits
+/// into. It's `i8*`, or a GC pointer if the function uses precise
+/// collection. The runtime functions are declared with the same types,
+/// since the statepoint rewriting can't see through casts into the GC
+/// address space.
+inline llvm::PointerType *getValueType(llvm::IRBuilder<> &builder) {
+  auto *bb = builder.GetInsertBlock();
+  if (bb != nullptr && bb->getParent() != nullptr &&
+      usesPreciseGC(*bb->getParent())) {
+    return getGCPointerType(builder.getContext());
+  }
+  return builder.getInt8PtrTy();
+};
+
+/// Split the insertion block of `builder` at its insertion point, move the
+/// builder to the end of the first half and return the second half, which
+/// is called `name`.
+inline llvm::BasicBlock *splitAtInsertPoint(llvm::IRBuilder<> &builder,
+                                            const llvm::Twine &name) {
+  auto *bb = builder.GetInsertBlock();
+  auto ip  = builder.GetInsertPoint();
+  llvm::BasicBlock *rest;
+
+  if (bb->getTerminator() != nullptr) {
+    rest = bb->splitBasicBlock(ip, name);
+    // We replace the branch that `splitBasicBlock` adds
+    bb->getTerminator()->eraseFromParent();
+  } else {
+    rest = llvm::BasicBlock::Create(builder.getContext(), name,
+                                    bb->getParent());
+    rest->getInstList().splice(rest->end(), bb->getInstList(), ip, bb->end());
+  }
+
+  builder.SetInsertPoint(bb);
+  return rest;
+};
+
+} // namespace serene::jit
+
+#endif
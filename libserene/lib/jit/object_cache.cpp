@@ -0,0 +1,527 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "serene/jit/object_cache.h"
+
+#include "serene/config.h"
+#include "serene/fs.h"
+#include "serene/jit/halley.h" // for HALLEY_LOG
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h> // for toHex
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CachePruning.h>
+#include <llvm/Support/Compression.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/FileSystem.h> // for OF_None
+#include <llvm/Support/Memory.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/ToolOutputFile.h> // for ToolOutputFile
+#include <llvm/Support/raw_ostream.h>
+
+#include <assert.h>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
+namespace serene::jit {
+
+namespace {
+/// A read only view to an object in the `ObjectStore` that shares the
+/// ownership of the object, so the store can drop the object while
+/// LLVM is still using it.
+class SharedObjectBuffer : public llvm::MemoryBuffer {
+public:
+  explicit SharedObjectBuffer(std::shared_ptr<llvm::MemoryBuffer> obj)
+      : obj(std::move(obj)) {
+    init(this->obj->getBufferStart(), this->obj->getBufferEnd(),
+         /*RequiresNullTerminator=*/false);
+  };
+
+  llvm::StringRef getBufferIdentifier() const override {
+    return obj->getBufferIdentifier();
+  };
+
+  BufferKind getBufferKind() const override { return obj->getBufferKind(); };
+
+private:
+  std::shared_ptr<llvm::MemoryBuffer> obj;
+};
+
+/// A read only buffer on top of a private memory mapping that we use as
+/// the scratch space to decompress objects into.
+class MappedObjectBuffer : public llvm::MemoryBuffer {
+public:
+  MappedObjectBuffer(llvm::sys::MemoryBlock block, size_t size,
+                     llvm::StringRef id)
+      : block(block), id(id.str()) {
+    const auto *start = static_cast<const char *>(block.base());
+    init(start, start + size, /*RequiresNullTerminator=*/false);
+  };
+
+  ~MappedObjectBuffer() override {
+    llvm::sys::Memory::releaseMappedMemory(block);
+  };
+
+  llvm::StringRef getBufferIdentifier() const override { return id; };
+
+  BufferKind getBufferKind() const override { return MemoryBuffer_MMap; };
+
+private:
+  llvm::sys::MemoryBlock block;
+  std::string id;
+};
+
+/// Compressed objects start with this magic number and the size of the
+/// uncompressed object as a 64 bit little endian integer.
+constexpr llvm::StringLiteral COMPRESSED_OBJECT_MAGIC("SRNZOBJ1");
+constexpr size_t COMPRESSED_OBJECT_HEADER_SIZE = 16;
+
+bool isCompressedObject(llvm::StringRef data) {
+  return data.size() >= COMPRESSED_OBJECT_HEADER_SIZE &&
+         data.startswith(COMPRESSED_OBJECT_MAGIC);
+};
+
+size_t getObjectSize(llvm::StringRef data) {
+  if (!isCompressedObject(data)) {
+    return data.size();
+  }
+
+  return llvm::support::endian::read64le(data.data() +
+                                         COMPRESSED_OBJECT_MAGIC.size());
+};
+
+std::unique_ptr<llvm::MemoryBuffer> compressObject(llvm::StringRef obj,
+                                                   llvm::StringRef id) {
+  llvm::SmallVector<uint8_t, 0> compressed;
+  llvm::compression::zlib::compress(llvm::arrayRefFromStringRef(obj),
+                                    compressed);
+
+  auto buf = llvm::WritableMemoryBuffer::getNewUninitMemBuffer(
+      COMPRESSED_OBJECT_HEADER_SIZE + compressed.size(), id);
+  auto *data = buf->getBufferStart();
+
+  memcpy(data, COMPRESSED_OBJECT_MAGIC.data(), COMPRESSED_OBJECT_MAGIC.size());
+  llvm::support::endian::write64le(data + COMPRESSED_OBJECT_MAGIC.size(),
+                                   obj.size());
+  memcpy(data + COMPRESSED_OBJECT_HEADER_SIZE, compressed.data(),
+         compressed.size());
+
+  return buf;
+};
+
+std::unique_ptr<llvm::MemoryBuffer>
+decompressObject(const llvm::MemoryBuffer &buf) {
+  auto data    = buf.getBuffer();
+  auto objSize = getObjectSize(data);
+
+  std::error_code ec;
+  auto block = llvm::sys::Memory::allocateMappedMemory(
+      objSize, nullptr,
+      llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE, ec);
+
+  if (ec) {
+    HALLEY_LOG("Can't map memory to decompress an object: " << ec.message());
+    return nullptr;
+  }
+
+  size_t size     = objSize;
+  auto compressed = data.drop_front(COMPRESSED_OBJECT_HEADER_SIZE);
+  auto err        = llvm::compression::zlib::uncompress(
+      llvm::arrayRefFromStringRef(compressed),
+      static_cast<uint8_t *>(block.base()), size);
+
+  if (err) {
+    HALLEY_LOG("Can't decompress object: " << err);
+    llvm::consumeError(std::move(err));
+    llvm::sys::Memory::releaseMappedMemory(block);
+    return nullptr;
+  }
+
+  // Nobody should write to the objects
+  llvm::sys::Memory::protectMappedMemory(block, llvm::sys::Memory::MF_READ);
+  return std::make_unique<MappedObjectBuffer>(block, size,
+                                              buf.getBufferIdentifier());
+};
+
+/// Return a buffer of the object in `obj` that LLVM can consume
+std::unique_ptr<llvm::MemoryBuffer>
+toObject(std::shared_ptr<llvm::MemoryBuffer> obj, bool isCompressed) {
+  if (isCompressed) {
+    return decompressObject(*obj);
+  }
+  return std::make_unique<SharedObjectBuffer>(std::move(obj));
+};
+} // namespace
+
+ObjectStore::ObjectStore(const Options &opts)
+    : maxMemorySize(opts.JITobjectCacheMaxMemory),
+      maxDiskSize(opts.JITobjectCacheMaxDiskSize),
+      dir(opts.JITobjectCacheDir),
+      compress(opts.JITcompressObjectCache &&
+               llvm::compression::zlib::isAvailable()) {
+  if (dir.empty()) {
+    return;
+  }
+
+  if (auto ec = llvm::sys::fs::create_directories(dir)) {
+    HALLEY_LOG("Can't create the object cache dir: " << ec.message());
+  }
+};
+
+std::shared_ptr<ObjectStore> ObjectStore::getProcessStore(const Options &opts) {
+  static std::mutex processStoreLock;
+  static std::weak_ptr<ObjectStore> processStore;
+
+  std::lock_guard<std::mutex> guard(processStoreLock);
+  auto store = processStore.lock();
+
+  if (!store) {
+    store        = std::make_shared<ObjectStore>(opts);
+    processStore = store;
+  }
+
+  return store;
+};
+
+void ObjectStore::insert(llvm::StringRef key,
+                         std::shared_ptr<llvm::MemoryBuffer> obj,
+                         size_t objSize, bool isCompressed) {
+  stats.memorySize += obj->getBufferSize();
+
+  Entry entry;
+  entry.obj          = std::move(obj);
+  entry.objSize      = objSize;
+  entry.isCompressed = isCompressed;
+
+  auto i = objects.try_emplace(key, std::move(entry)).first;
+  lru.push_front(i->first());
+  i->second.lruPos = lru.begin();
+};
+
+void ObjectStore::evict() {
+  if (maxMemorySize == 0) {
+    return;
+  }
+
+  while (stats.memorySize > maxMemorySize && !lru.empty()) {
+    auto i = objects.find(lru.back());
+    assert(i != objects.end() && "LRU list is out of sync with the store");
+
+    HALLEY_LOG("Evicting object " << i->first() << " with " << i->second.hits
+                                  << " hits");
+    stats.memorySize -= i->second.obj->getBufferSize();
+    stats.evictions++;
+    lru.pop_back();
+    objects.erase(i);
+  }
+};
+
+std::unique_ptr<llvm::MemoryBuffer> ObjectStore::get(llvm::StringRef key) {
+  std::shared_ptr<llvm::MemoryBuffer> obj;
+  bool isCompressed = false;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto i = objects.find(key);
+
+    if (i != objects.end()) {
+      auto &entry = i->second;
+      entry.hits++;
+      stats.hits++;
+      lru.splice(lru.begin(), lru, entry.lruPos);
+
+      obj          = entry.obj;
+      isCompressed = entry.isCompressed;
+    }
+  }
+
+  if (obj) {
+    return toObject(std::move(obj), isCompressed);
+  }
+
+  std::shared_ptr<llvm::MemoryBuffer> file = readFromDisk(key);
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (!file) {
+    stats.misses++;
+    return nullptr;
+  }
+
+  stats.diskHits++;
+
+  // Files might be compressed even if compression is disabled now
+  auto data = file->getBuffer();
+  if (objects.count(key) == 0) {
+    insert(key, file, getObjectSize(data), isCompressedObject(data));
+    evict();
+  }
+
+  return toObject(std::move(file), isCompressedObject(data));
+};
+
+void ObjectStore::put(llvm::StringRef key, llvm::MemoryBufferRef objBuffer) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (objects.count(key) != 0) {
+      return;
+    }
+  }
+
+  std::shared_ptr<llvm::MemoryBuffer> obj =
+      compress ? compressObject(objBuffer.getBuffer(),
+                                objBuffer.getBufferIdentifier())
+               : llvm::MemoryBuffer::getMemBufferCopy(
+                     objBuffer.getBuffer(), objBuffer.getBufferIdentifier());
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (objects.count(key) != 0) {
+      return;
+    }
+
+    insert(key, obj, objBuffer.getBufferSize(), compress);
+    evict();
+  }
+
+  writeToDisk(key, obj->getBuffer());
+};
+
+size_t ObjectStore::size() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return objects.size();
+};
+
+ObjectStoreStats ObjectStore::getStats() const {
+  std::lock_guard<std::mutex> guard(lock);
+  auto result    = stats;
+  result.entries = objects.size();
+  return result;
+};
+
+void ObjectStore::trim() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    evict();
+  }
+
+  if (dir.empty()) {
+    return;
+  }
+
+  llvm::CachePruningPolicy policy;
+  // Force the pruning, it's up to the caller to decide how often they
+  // want to trim the store.
+  policy.Interval     = std::chrono::seconds(0);
+  policy.MaxSizeBytes = maxDiskSize;
+
+  if (!llvm::pruneCache(dir, policy)) {
+    HALLEY_LOG("Failed to prune the object cache dir: " << dir);
+  }
+};
+
+std::string ObjectStore::getPathFor(llvm::StringRef key) const {
+  // `pruneCache` only considers files with the `llvmcache-` prefix
+  return fs::join(dir, "llvmcache-" + key.str());
+};
+
+void ObjectStore::writeToDisk(llvm::StringRef key, llvm::StringRef data) const {
+  if (dir.empty()) {
+    return;
+  }
+
+  auto path = getPathFor(key);
+  if (fs::exists(path)) {
+    return;
+  }
+
+  // Write to a temporary file first and then move it in place, so other
+  // processes that share the directory never see a half written object.
+  int fd = 0;
+  llvm::SmallString<MAX_PATH_SLOTS> tmpPath;
+  if (auto ec = llvm::sys::fs::createUniqueFile(
+          fs::join(dir, "tmp-%%%%%%%%%%%%"), fd, tmpPath)) {
+    HALLEY_LOG("Can't create a temp file in the object cache dir: "
+               << ec.message());
+    return;
+  }
+
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os << data;
+    os.close();
+
+    if (os.has_error()) {
+      HALLEY_LOG("Can't write object to: " << tmpPath);
+      os.clear_error();
+      llvm::sys::fs::remove(tmpPath);
+      return;
+    }
+  }
+
+  if (auto ec = llvm::sys::fs::rename(tmpPath, path)) {
+    HALLEY_LOG("Can't move object to: " << path << " " << ec.message());
+    llvm::sys::fs::remove(tmpPath);
+  }
+};
+
+std::unique_ptr<llvm::MemoryBuffer>
+ObjectStore::readFromDisk(llvm::StringRef key) const {
+  if (dir.empty()) {
+    return nullptr;
+  }
+
+  auto path = getPathFor(key);
+  auto buf  = llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                         /*RequiresNullTerminator=*/false);
+  if (!buf) {
+    return nullptr;
+  }
+
+  // Mark the file as recently used, so the pruning keeps it around
+  // even if the file system doesn't track the access time.
+  int fd = 0;
+  if (!llvm::sys::fs::openFileForReadWrite(path, fd,
+                                           llvm::sys::fs::CD_OpenExisting,
+                                           llvm::sys::fs::OF_None)) {
+    llvm::sys::fs::setLastAccessAndModificationTime(
+        fd, std::chrono::time_point_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now()));
+    llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  }
+
+  return std::move(*buf);
+};
+
+void ObjectCache::setCodeGenSettings(std::string settings) {
+  std::lock_guard<std::mutex> guard(lock);
+  codegenSettings = std::move(settings);
+};
+
+std::string ObjectCache::computeKey(const llvm::Module *m) {
+  std::unique_lock<std::mutex> guard(lock);
+  llvm::SmallVector<char, 0> content(codegenSettings.begin(),
+                                     codegenSettings.end());
+  guard.unlock();
+
+  // Since the bitcode does not contain the module identifier, two
+  // modules with different names but the same content share a key.
+  llvm::raw_svector_ostream os(content);
+  llvm::WriteBitcodeToFile(*m, os);
+
+  auto hash = llvm::SHA1::hash(llvm::arrayRefFromStringRef(os.str()));
+  return llvm::toHex(hash, /*LowerCase=*/true);
+};
+
+void ObjectCache::notifyObjectCompiled(const llvm::Module *m,
+                                       llvm::MemoryBufferRef objBuffer) {
+  std::string key;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto i = pendingKeys.find(m);
+    if (i != pendingKeys.end()) {
+      key = std::move(i->second);
+      pendingKeys.erase(i);
+    }
+  }
+
+  if (key.empty()) {
+    key = computeKey(m);
+  }
+  store->put(key, objBuffer);
+
+  std::lock_guard<std::mutex> guard(lock);
+  keys.push_back(std::move(key));
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+ObjectCache::getObject(const llvm::Module *m) {
+  // Never use a pending key here, it might belong to a module that was
+  // freed before it got compiled
+  auto key = computeKey(m);
+  auto obj = store->get(key);
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (!obj) {
+    HALLEY_LOG("No object for " + m->getModuleIdentifier() +
+               " in cache. Compiling.");
+    // LLVM is going to compile the module and call `notifyObjectCompiled`
+    // with the same module right after.
+    pendingKeys[m] = std::move(key);
+    return nullptr;
+  }
+
+  HALLEY_LOG("Object for " + m->getModuleIdentifier() + " loaded from cache.");
+  keys.push_back(std::move(key));
+  return obj;
+}
+
+void ObjectCache::discardPendingKey(const llvm::Module *m) {
+  std::lock_guard<std::mutex> guard(lock);
+  pendingKeys.erase(m);
+};
+
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+ObjectCacheCompiler::operator()(llvm::Module &m) {
+  auto obj = (*compiler)(m);
+  if (!obj) {
+    cache.discardPendingKey(&m);
+  }
+  return obj;
+};
+
+void ObjectCache::dumpToObjectFile(llvm::StringRef outputFilename) {
+  // Set up the output file.
+  std::error_code error;
+
+  auto file = std::make_unique<llvm::ToolOutputFile>(outputFilename, error,
+                                                     llvm::sys::fs::OF_None);
+  if (error) {
+
+    llvm::errs() << "cannot open output file '" + outputFilename.str() +
+                        "': " + error.message()
+                 << "\n";
+    return;
+  }
+  // Dump the object generated for a single module to the output file.
+  // TODO: Replace this with a runtime check
+  assert(keys.size() == 1 && "Expected only one object entry.");
+
+  auto cachedObject = store->get(keys.front());
+  assert(cachedObject && "The object is missing from the store.");
+
+  file->os() << cachedObject->getBuffer();
+  file->keep();
+}
+
+std::unique_ptr<ObjectCache> makeObjectCache(const Options &opts) {
+  if (!opts.JITenableObjectCache) {
+    return nullptr;
+  }
+
+  auto store = opts.JITshareObjectCache ? ObjectStore::getProcessStore(opts)
+                                        : std::make_shared<ObjectStore>(opts);
+
+  return std::make_unique<ObjectCache>(std::move(store));
+};
+
+} // namespace serene::jit
@@ -29,9 +29,66 @@ std::string makePackedFunctionName(llvm::StringRef name) {
   return PACKED_FUNCTION_NAME_PREFIX + name.str();
 }
 
-void packFunctionArguments(llvm::Module *module) {
-  auto &ctx = module->getContext();
+llvm::StructType *getSliceType(llvm::LLVMContext &ctx) {
+  return llvm::StructType::get(ctx, {llvm::Type::getInt8PtrTy(ctx),
+                                     llvm::Type::getInt64Ty(ctx)});
+};
+
+llvm::Function *definePackedFunction(llvm::Module &module,
+                                     llvm::Function &func) {
+  auto &ctx = module.getContext();
   llvm::IRBuilder<> builder(ctx);
+
+  // Given a function `foo(<...>)`, define the interface function
+  // `serene_foo(i8**)`.
+  auto *newType = llvm::FunctionType::get(
+      builder.getVoidTy(), builder.getInt8PtrTy()->getPointerTo(),
+      /*isVarArg=*/false);
+  auto newName = makePackedFunctionName(func.getName());
+  auto funcCst = module.getOrInsertFunction(newName, newType);
+  llvm::Function *interfaceFunc =
+      llvm::cast<llvm::Function>(funcCst.getCallee());
+
+  // Extract the arguments from the type-erased argument list and cast them to
+  // the proper types.
+  auto *bb = llvm::BasicBlock::Create(ctx);
+  bb->insertInto(interfaceFunc);
+  builder.SetInsertPoint(bb);
+  llvm::Value *argList = interfaceFunc->arg_begin();
+  llvm::SmallVector<llvm::Value *, COMMON_ARGS_COUNT> args;
+  args.reserve(llvm::size(func.args()));
+  for (const auto &indexedArg : llvm::enumerate(func.args())) {
+    llvm::Value *argIndex = llvm::Constant::getIntegerValue(
+        builder.getInt64Ty(), llvm::APInt(I64_SIZE, indexedArg.index()));
+    llvm::Value *argPtrPtr =
+        builder.CreateGEP(builder.getInt8PtrTy(), argList, argIndex);
+    llvm::Value *argPtr = builder.CreateLoad(builder.getInt8PtrTy(), argPtrPtr);
+    llvm::Type *argTy   = indexedArg.value().getType();
+    argPtr              = builder.CreateBitCast(argPtr, argTy->getPointerTo());
+    llvm::Value *arg    = builder.CreateLoad(argTy, argPtr);
+    args.push_back(arg);
+  }
+
+  // Call the implementation function with the extracted arguments.
+  llvm::Value *result = builder.CreateCall(&func, args);
+
+  // Assuming the result is one value, potentially of type `void`.
+  if (!result->getType()->isVoidTy()) {
+    llvm::Value *retIndex = llvm::Constant::getIntegerValue(
+        builder.getInt64Ty(), llvm::APInt(I64_SIZE, llvm::size(func.args())));
+    llvm::Value *retPtrPtr =
+        builder.CreateGEP(builder.getInt8PtrTy(), argList, retIndex);
+    llvm::Value *retPtr = builder.CreateLoad(builder.getInt8PtrTy(), retPtrPtr);
+    retPtr = builder.CreateBitCast(retPtr, result->getType()->getPointerTo());
+    builder.CreateStore(result, retPtr);
+  }
+
+  // The interface function returns void.
+  builder.CreateRetVoid();
+  return interfaceFunc;
+};
+
+void packFunctionArguments(llvm::Module *module) {
   llvm::DenseSet<llvm::Function *> interfaceFunctions;
   for (auto &func : module->getFunctionList()) {
     if (func.isDeclaration()) {
@@ -40,56 +97,198 @@ void packFunctionArguments(llvm::Module *module) {
     if (interfaceFunctions.count(&func) != 0) {
       continue;
     }
-
-    // Given a function `foo(<...>)`, define the interface function
-    // `serene_foo(i8**)`.
-    auto *newType = llvm::FunctionType::get(
-        builder.getVoidTy(), builder.getInt8PtrTy()->getPointerTo(),
-        /*isVarArg=*/false);
-    auto newName = makePackedFunctionName(func.getName());
-    auto funcCst = module->getOrInsertFunction(newName, newType);
-    llvm::Function *interfaceFunc =
-        llvm::cast<llvm::Function>(funcCst.getCallee());
-    interfaceFunctions.insert(interfaceFunc);
-
-    // Extract the arguments from the type-erased argument list and cast them to
-    // the proper types.
-    auto *bb = llvm::BasicBlock::Create(ctx);
-    bb->insertInto(interfaceFunc);
-    builder.SetInsertPoint(bb);
-    llvm::Value *argList = interfaceFunc->arg_begin();
-    llvm::SmallVector<llvm::Value *, COMMON_ARGS_COUNT> args;
-    args.reserve(llvm::size(func.args()));
-    for (const auto &indexedArg : llvm::enumerate(func.args())) {
-      llvm::Value *argIndex = llvm::Constant::getIntegerValue(
-          builder.getInt64Ty(), llvm::APInt(I64_SIZE, indexedArg.index()));
-      llvm::Value *argPtrPtr =
-          builder.CreateGEP(builder.getInt8PtrTy(), argList, argIndex);
-      llvm::Value *argPtr =
-          builder.CreateLoad(builder.getInt8PtrTy(), argPtrPtr);
-      llvm::Type *argTy = indexedArg.value().getType();
-      argPtr            = builder.CreateBitCast(argPtr, argTy->getPointerTo());
-      llvm::Value *arg  = builder.CreateLoad(argTy, argPtr);
-      args.push_back(arg);
+    // Direct and batch wrappers are interface functions already
+    if (func.getName().startswith(DIRECT_FUNCTION_NAME_PREFIX) ||
+        func.getName().startswith(BATCH_FUNCTION_NAME_PREFIX)) {
+      continue;
     }
 
-    // Call the implementation function with the extracted arguments.
-    llvm::Value *result = builder.CreateCall(&func, args);
-
-    // Assuming the result is one value, potentially of type `void`.
-    if (!result->getType()->isVoidTy()) {
-      llvm::Value *retIndex = llvm::Constant::getIntegerValue(
-          builder.getInt64Ty(), llvm::APInt(I64_SIZE, llvm::size(func.args())));
-      llvm::Value *retPtrPtr =
-          builder.CreateGEP(builder.getInt8PtrTy(), argList, retIndex);
-      llvm::Value *retPtr =
-          builder.CreateLoad(builder.getInt8PtrTy(), retPtrPtr);
-      retPtr = builder.CreateBitCast(retPtr, result->getType()->getPointerTo());
-      builder.CreateStore(result, retPtr);
-    }
+    interfaceFunctions.insert(definePackedFunction(*module, func));
+  }
+};
+
+std::string makeDirectFunctionName(llvm::StringRef name) {
+  return DIRECT_FUNCTION_NAME_PREFIX + name.str();
+};
+
+/// Whether values of the given type `t` are passed in registers or not. It
+/// has to agree with `Packer::isRegisterType`.
+static bool isRegisterType(const llvm::Type *t) {
+  if (t->isPointerTy() || t->isFloatTy() || t->isDoubleTy()) {
+    return true;
+  }
+
+  return t->isIntegerTy() && t->getIntegerBitWidth() <= I64_SIZE;
+};
+
+bool isDirectlyCallable(const llvm::FunctionType &fnTy) {
+  if (fnTy.isVarArg() || fnTy.getNumParams() > Packer::maxDirectArgsCount) {
+    return false;
+  }
+
+  auto *retTy = fnTy.getReturnType();
+  if (!retTy->isVoidTy() && !isRegisterType(retTy)) {
+    return false;
+  }
+
+  return llvm::all_of(fnTy.params(), isRegisterType);
+};
+
+bool isDirectlyCallable(const llvm::Function &fn) {
+  if (fn.isDeclaration()) {
+    return false;
+  }
+
+  // Wrappers are not wrapped again
+  if (fn.getName().startswith(PACKED_FUNCTION_NAME_PREFIX)) {
+    return false;
+  }
+
+  return isDirectlyCallable(*fn.getFunctionType());
+};
+
+llvm::Function *defineDirectFunction(llvm::Module &module,
+                                     llvm::Function &func) {
+  auto &ctx = module.getContext();
+  llvm::IRBuilder<> builder(ctx);
+
+  // Given a function `foo(<...>)`, define `__serene_d_foo(<...>)` with
+  // the C calling convention that tail calls `foo`. It lets the host
+  // call `foo` regardless of its linkage and calling convention.
+  auto funcCst = module.getOrInsertFunction(
+      makeDirectFunctionName(func.getName()), func.getFunctionType());
+  auto *directFunc = llvm::cast<llvm::Function>(funcCst.getCallee());
+
+  if (!directFunc->isDeclaration()) {
+    // It's already defined
+    return directFunc;
+  }
 
-    // The interface function returns void.
+  directFunc->setCallingConv(llvm::CallingConv::C);
+
+  auto *bb = llvm::BasicBlock::Create(ctx, "entry", directFunc);
+  builder.SetInsertPoint(bb);
+
+  llvm::SmallVector<llvm::Value *, COMMON_ARGS_COUNT> args;
+  for (auto &arg : directFunc->args()) {
+    args.push_back(&arg);
+  }
+
+  auto *call = builder.CreateCall(&func, args);
+  call->setCallingConv(func.getCallingConv());
+  call->setTailCall();
+
+  if (call->getType()->isVoidTy()) {
     builder.CreateRetVoid();
+  } else {
+    builder.CreateRet(call);
+  }
+
+  return directFunc;
+};
+
+std::string makeBatchFunctionName(llvm::StringRef name) {
+  return BATCH_FUNCTION_NAME_PREFIX + name.str();
+};
+
+bool isBatchCallable(const llvm::FunctionType &fnTy) {
+  if (fnTy.isVarArg() || !isRegisterType(fnTy.getReturnType())) {
+    return false;
+  }
+
+  return llvm::all_of(fnTy.params(), isRegisterType);
+};
+
+llvm::Function *defineBatchFunction(llvm::Module &module,
+                                    llvm::Function &func) {
+  auto &ctx = module.getContext();
+  llvm::IRBuilder<> builder(ctx);
+
+  auto *i8PtrTy = builder.getInt8PtrTy();
+  auto *i64Ty   = builder.getInt64Ty();
+
+  // Given a function `foo(<...>)`, define `__serene_b_foo(i8**, i64)`. The
+  // first argument is a list of pointers to the columns of arguments
+  // followed by a pointer to the column of results and the second one is
+  // the number of rows.
+  auto *newType = llvm::FunctionType::get(
+      builder.getVoidTy(), {i8PtrTy->getPointerTo(), i64Ty},
+      /*isVarArg=*/false);
+  auto funcCst = module.getOrInsertFunction(
+      makeBatchFunctionName(func.getName()), newType);
+  auto *batchFunc = llvm::cast<llvm::Function>(funcCst.getCallee());
+
+  if (!batchFunc->isDeclaration()) {
+    return batchFunc;
+  }
+
+  auto *entry = llvm::BasicBlock::Create(ctx, "entry", batchFunc);
+  auto *loop  = llvm::BasicBlock::Create(ctx, "loop", batchFunc);
+  auto *exit  = llvm::BasicBlock::Create(ctx, "exit", batchFunc);
+
+  llvm::Value *columns = batchFunc->getArg(0);
+  llvm::Value *count   = batchFunc->getArg(1);
+
+  // Load the base of every column once, outside of the loop
+  builder.SetInsertPoint(entry);
+  auto loadColumn = [&](size_t index, llvm::Type *elemTy) {
+    auto *colPtrPtr = builder.CreateGEP(
+        i8PtrTy, columns,
+        llvm::Constant::getIntegerValue(i64Ty, llvm::APInt(I64_SIZE, index)));
+    auto *colPtr = builder.CreateLoad(i8PtrTy, colPtrPtr);
+    return builder.CreateBitCast(colPtr, elemTy->getPointerTo());
+  };
+
+  llvm::SmallVector<llvm::Value *, COMMON_ARGS_COUNT> argColumns;
+  for (const auto &indexedArg : llvm::enumerate(func.args())) {
+    argColumns.push_back(
+        loadColumn(indexedArg.index(), indexedArg.value().getType()));
+  }
+
+  auto *resultTy     = func.getReturnType();
+  auto *resultColumn = loadColumn(func.arg_size(), resultTy);
+
+  auto *isEmpty = builder.CreateICmpEQ(count, builder.getInt64(0));
+  builder.CreateCondBr(isEmpty, exit, loop);
+
+  // The loop body: results[i] = func(col0[i], col1[i], ...)
+  builder.SetInsertPoint(loop);
+  auto *i = builder.CreatePHI(i64Ty, 2);
+  i->addIncoming(builder.getInt64(0), entry);
+
+  llvm::SmallVector<llvm::Value *, COMMON_ARGS_COUNT> args;
+  for (const auto &indexedArg : llvm::enumerate(func.args())) {
+    auto *argTy = indexedArg.value().getType();
+    auto *argPtr =
+        builder.CreateGEP(argTy, argColumns[indexedArg.index()], i);
+    args.push_back(builder.CreateLoad(argTy, argPtr));
+  }
+
+  auto *call = builder.CreateCall(&func, args);
+  call->setCallingConv(func.getCallingConv());
+  builder.CreateStore(call, builder.CreateGEP(resultTy, resultColumn, i));
+
+  auto *next = builder.CreateAdd(i, builder.getInt64(1));
+  i->addIncoming(next, loop);
+  builder.CreateCondBr(builder.CreateICmpEQ(next, count), exit, loop);
+
+  builder.SetInsertPoint(exit);
+  builder.CreateRetVoid();
+
+  return batchFunc;
+};
+
+void defineDirectFunctions(llvm::Module *module) {
+  // Collect them first since we're adding functions to the module
+  llvm::SmallVector<llvm::Function *, COMMON_ARGS_COUNT> targets;
+  for (auto &func : module->getFunctionList()) {
+    if (isDirectlyCallable(func)) {
+      targets.push_back(&func);
+    }
+  }
+
+  for (auto *func : targets) {
+    defineDirectFunction(*module, *func);
   }
 };
 
@@ -0,0 +1,241 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "serene/jit/statepoints.h"
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Object/StackMapParser.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Scalar/RewriteStatepointsForGC.h>
+
+#include <cassert>
+
+namespace serene::jit {
+
+// The DWARF numbers of the registers that the stack slots are relative to
+static constexpr uint16_t x86FramePointerReg = 6;
+static constexpr uint16_t x86StackPointerReg = 7;
+
+// Every statepoint record starts with three constants, the calling
+// convention, the flags and the number of the deopt locations. Then the
+// deopt locations and then a base and a derived location for every GC
+// pointer follow.
+static constexpr unsigned statepointHeaderLocations = 3;
+
+llvm::PointerType *getGCPointerType(llvm::LLVMContext &ctx) {
+  return llvm::Type::getInt8PtrTy(ctx, gcAddressSpace);
+};
+
+void usePreciseGC(llvm::Function &fn) {
+  fn.setGC(preciseGCStrategy);
+  // The stack walker follows the chain of the frame pointers
+  fn.addFnAttr("frame-pointer", "all");
+};
+
+bool usesPreciseGC(const llvm::Function &fn) {
+  return fn.hasGC() && fn.getGC() == preciseGCStrategy;
+};
+
+void rewriteStatepoints(llvm::Module &m) {
+  for (auto &fn : m) {
+    if (!fn.isDeclaration()) {
+      usePreciseGC(fn);
+    }
+  }
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  llvm::PassBuilder pb;
+  pb.registerModuleAnalyses(mam);
+  pb.registerCGSCCAnalyses(cgam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+  llvm::ModulePassManager mpm;
+  mpm.addPass(llvm::RewriteStatepointsForGC());
+  mpm.run(m, mam);
+};
+
+llvm::Error StackMapRegistry::add(uint64_t key,
+                                  llvm::ArrayRef<uint8_t> section) {
+  using Parser = llvm::StackMapParser<llvm::support::native>;
+
+  if (auto err = Parser::validateHeader(section)) {
+    return err;
+  }
+
+  Parser parser(section);
+  std::lock_guard<std::mutex> guard(lock);
+  auto &addresses = objects[key];
+
+  // The records are in the same order as the functions and every function
+  // owns the next `getRecordCount` of them
+  auto record = parser.records_begin();
+  for (const auto &fn : parser.functions()) {
+    for (uint64_t i = 0; i < fn.getRecordCount(); ++i, ++record) {
+      CallSite site;
+      bool supported = true;
+
+      auto numLocations = record->getNumLocations();
+      assert(numLocations >= statepointHeaderLocations &&
+             "Not a statepoint record");
+
+      auto firstRoot = statepointHeaderLocations +
+                       record->getLocation(2).getSmallConstant();
+
+      auto toSlot = [&](const Parser::LocationAccessor &loc) -> Slot {
+        auto reg = loc.getDwarfRegNum();
+        if (loc.getKind() != Parser::LocationKind::Indirect ||
+            (reg != x86StackPointerReg && reg != x86FramePointerReg)) {
+          supported = false;
+          return {};
+        }
+        return {reg, loc.getOffset()};
+      };
+
+      for (auto l = firstRoot; l + 1 < numLocations; l += 2) {
+        site.roots.push_back({toSlot(record->getLocation(l)),
+                              toSlot(record->getLocation(l + 1))});
+      }
+
+      // The default lowering spills every GC pointer to the stack. If it
+      // didn't, we leave the call site out and its frame and the ones
+      // after it go to the conservative scanning.
+      if (!supported) {
+        continue;
+      }
+
+      auto returnAddress =
+          fn.getFunctionAddress() + record->getInstructionOffset();
+      callSites[returnAddress] = std::move(site);
+      addresses.push_back(returnAddress);
+    }
+  }
+
+  return llvm::Error::success();
+};
+
+void StackMapRegistry::remove(uint64_t key) {
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = objects.find(key);
+  if (it == objects.end()) {
+    return;
+  }
+
+  for (auto address : it->second) {
+    callSites.erase(address);
+  }
+  objects.erase(it);
+};
+
+void StackMapRegistry::visitRoots(void *framePointer,
+                                  RootVisitor visit) const {
+  std::lock_guard<std::mutex> guard(lock);
+
+  // On x86-64 a frame pointer points to the saved frame pointer of the
+  // caller, followed by the return address into the caller. The stack
+  // pointer of the caller right before the call is right after them.
+  auto **fp = static_cast<void **>(framePointer);
+  while (fp != nullptr) {
+    auto site = callSites.find(reinterpret_cast<uint64_t>(fp[1]));
+    if (site == callSites.end()) {
+      // Not a JIT compiled frame
+      break;
+    }
+
+    auto *sp        = reinterpret_cast<char *>(fp + 2);
+    auto **callerFP = static_cast<void **>(fp[0]);
+
+    auto address = [&](const Slot &s) {
+      auto *base = s.reg == x86StackPointerReg
+                       ? sp
+                       : reinterpret_cast<char *>(callerFP);
+      return reinterpret_cast<void **>(base + s.offset);
+    };
+
+    for (const auto &root : site->second.roots) {
+      visit(address(root.base), address(root.derived));
+    }
+
+    fp = callerFP;
+  }
+};
+
+size_t StackMapRegistry::size() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return callSites.size();
+};
+
+StackMapRegistry &getStackMapRegistry() {
+  static StackMapRegistry registry;
+  return registry;
+};
+
+void StackMapListener::notifyObjectLoaded(
+    ObjectKey key, const llvm::object::ObjectFile &obj,
+    const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+
+  for (const auto &section : obj.sections()) {
+    auto name = section.getName();
+    // `.llvm_stackmaps` on ELF and COFF and `__llvm_stackmaps` on MachO
+    if (!name || !name->endswith("llvm_stackmaps")) {
+      if (!name) {
+        llvm::consumeError(name.takeError());
+      }
+      continue;
+    }
+
+    // We need the relocated copy of the section that the JIT loaded, the
+    // function addresses in the copy of the object file are not resolved
+    auto address = info.getSectionLoadAddress(section);
+    if (address == 0) {
+      continue;
+    }
+
+    llvm::ArrayRef<uint8_t> contents(
+        reinterpret_cast<const uint8_t *>(static_cast<uintptr_t>(address)),
+        section.getSize());
+
+    if (auto err = registry.add(key, contents)) {
+      llvm::errs() << "Failed to register the stack maps: "
+                   << llvm::toString(std::move(err)) << "\n";
+    }
+  }
+};
+
+void StackMapListener::notifyFreeingObject(ObjectKey key) {
+  registry.remove(key);
+};
+
+llvm::JITEventListener *getStackMapListener() {
+  static StackMapListener listener(getStackMapRegistry());
+  return &listener;
+};
+
+} // namespace serene::jit
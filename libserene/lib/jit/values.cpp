@@ -0,0 +1,255 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "serene/jit/values.h"
+
+#include "./ir_utils.h"
+
+#include "serene/config.h"
+#include "serene/types/value.h"
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+
+namespace serene::jit {
+
+llvm::Value *emitFixnum(llvm::IRBuilder<> &builder, int64_t i) {
+  assert(types::fitsFixnum(i) && "The integer doesn't fit in a fixnum");
+  auto word = types::toWord(types::makeFixnum(i));
+  return llvm::ConstantExpr::getIntToPtr(builder.getInt64(word),
+                                         getValueType(builder));
+};
+
+static const char *getSlowPathName(ArithmeticOp op) {
+  switch (op) {
+  case ArithmeticOp::Add:
+    return NUMBER_ADD_FUNCTION_NAME;
+  case ArithmeticOp::Subtract:
+    return NUMBER_SUBTRACT_FUNCTION_NAME;
+  case ArithmeticOp::Multiply:
+    return NUMBER_MULTIPLY_FUNCTION_NAME;
+  }
+  llvm_unreachable("Unknown arithmetic operation");
+};
+
+static llvm::Intrinsic::ID getOverflowIntrinsic(ArithmeticOp op) {
+  switch (op) {
+  case ArithmeticOp::Add:
+    return llvm::Intrinsic::sadd_with_overflow;
+  case ArithmeticOp::Subtract:
+    return llvm::Intrinsic::ssub_with_overflow;
+  case ArithmeticOp::Multiply:
+    return llvm::Intrinsic::smul_with_overflow;
+  }
+  llvm_unreachable("Unknown arithmetic operation");
+};
+
+llvm::Value *emitArithmetic(llvm::IRBuilder<> &builder, ArithmeticOp op,
+                            llvm::Value *a, llvm::Value *b) {
+  auto &module  = getModule(builder);
+  auto &ctx     = builder.getContext();
+  auto *valueTy = getValueType(builder);
+  auto *i64Ty   = builder.getInt64Ty();
+
+  auto slowPath = module.getOrInsertFunction(
+      getSlowPathName(op),
+      llvm::FunctionType::get(valueTy, {valueTy, valueTy}, /*isVarArg=*/false));
+
+  auto *fn     = builder.GetInsertBlock()->getParent();
+  auto *cont   = splitAtInsertPoint(builder, "num.cont");
+  auto *fixnum = llvm::BasicBlock::Create(ctx, "num.fixnum", fn, cont);
+  auto *slow   = llvm::BasicBlock::Create(ctx, "num.slow", fn, cont);
+  auto weights = llvm::MDBuilder(ctx).createBranchWeights(1 << 20, 1);
+
+  auto *x     = builder.CreatePtrToInt(a, i64Ty);
+  auto *y     = builder.CreatePtrToInt(b, i64Ty);
+  auto *tags  = builder.CreateAnd(builder.CreateAnd(x, y), types::fixnumTag);
+  auto *isFix = builder.CreateICmpNE(tags, builder.getInt64(0));
+  builder.CreateCondBr(isFix, fixnum, slow, weights);
+
+  // See `serene/core/number.h` for the math behind the words
+  builder.SetInsertPoint(fixnum);
+  auto *lhs = op == ArithmeticOp::Multiply ? builder.CreateAShr(x, 1) : x;
+  auto *rhs = builder.CreateSub(y, builder.getInt64(types::fixnumTag));
+  auto *withOverflow = builder.CreateBinaryIntrinsic(getOverflowIntrinsic(op),
+                                                     lhs, rhs, nullptr);
+  auto *word         = builder.CreateExtractValue(withOverflow, 0);
+  auto *overflow     = builder.CreateExtractValue(withOverflow, 1);
+
+  if (op == ArithmeticOp::Multiply) {
+    word = builder.CreateOr(word, types::fixnumTag);
+  }
+
+  auto *fast = builder.CreateIntToPtr(word, valueTy);
+  builder.CreateCondBr(overflow, slow, cont,
+                       llvm::MDBuilder(ctx).createBranchWeights(1, 1 << 20));
+
+  builder.SetInsertPoint(slow);
+  auto *promoted = builder.CreateCall(slowPath, {a, b});
+  promoted->addFnAttr(llvm::Attribute::Cold);
+  builder.CreateBr(cont);
+
+  builder.SetInsertPoint(cont, cont->begin());
+  auto *result = builder.CreatePHI(valueTy, 2, "num");
+  result->addIncoming(fast, fixnum);
+  result->addIncoming(promoted, slow);
+  return result;
+};
+
+static llvm::Value *getAtomField(llvm::IRBuilder<> &builder,
+                                 llvm::Value *atom, unsigned offset) {
+  // The field lives in the atom, so it's in the address space of the atom
+  auto *valueTy = getValueType(builder);
+  auto *field   = builder.CreateConstInBoundsGEP1_64(builder.getInt8Ty(),
+                                                     atom, offset);
+  return builder.CreateBitCast(
+      field, valueTy->getPointerTo(valueTy->getAddressSpace()));
+};
+
+static llvm::Value *loadAtomField(llvm::IRBuilder<> &builder,
+                                  llvm::Value *atom, unsigned offset,
+                                  llvm::AtomicOrdering ordering) {
+  auto *load = builder.CreateAlignedLoad(getValueType(builder),
+                                         getAtomField(builder, atom, offset),
+                                         llvm::Align(8));
+  load->setAtomic(ordering);
+  return load;
+};
+
+/// Call the watches of `atom` if it has any, which it usually doesn't
+static void emitNotifyWatches(llvm::IRBuilder<> &builder, llvm::Value *atom,
+                              llvm::Value *oldValue, llvm::Value *newValue) {
+  auto &module  = getModule(builder);
+  auto &ctx     = builder.getContext();
+  auto *valueTy = getValueType(builder);
+
+  auto notify = module.getOrInsertFunction(
+      ATOM_NOTIFY_WATCHES_FUNCTION_NAME,
+      llvm::FunctionType::get(builder.getVoidTy(),
+                              {valueTy, valueTy, valueTy},
+                              /*isVarArg=*/false));
+
+  // The runtime loads the watches again with the right ordering
+  auto *watches = loadAtomField(builder, atom, types::atomWatchesOffset,
+                                llvm::AtomicOrdering::Monotonic);
+
+  auto *fn    = builder.GetInsertBlock()->getParent();
+  auto *cont  = splitAtInsertPoint(builder, "atom.cont");
+  auto *watch = llvm::BasicBlock::Create(ctx, "atom.watch", fn, cont);
+  builder.CreateCondBr(builder.CreateIsNotNull(watches), watch, cont,
+                       llvm::MDBuilder(ctx).createBranchWeights(1, 1 << 20));
+
+  builder.SetInsertPoint(watch);
+  builder.CreateCall(notify, {atom, oldValue, newValue})
+      ->addFnAttr(llvm::Attribute::Cold);
+  builder.CreateBr(cont);
+
+  builder.SetInsertPoint(cont, cont->begin());
+};
+
+llvm::Value *emitAtomDeref(llvm::IRBuilder<> &builder, llvm::Value *atom) {
+  return loadAtomField(builder, atom, types::atomValueOffset,
+                       llvm::AtomicOrdering::Acquire);
+};
+
+llvm::Value *emitAtomReset(llvm::IRBuilder<> &builder, llvm::Value *atom,
+                           llvm::Value *v) {
+  // `xchg` only takes integers before LLVM 15, so it swaps the word
+  auto *i64Ty   = builder.getInt64Ty();
+  auto *valueTy = getValueType(builder);
+  auto *field   = builder.CreateBitCast(
+      getAtomField(builder, atom, types::atomValueOffset),
+      i64Ty->getPointerTo(valueTy->getAddressSpace()));
+  auto *oldWord = builder.CreateAtomicRMW(
+      llvm::AtomicRMWInst::Xchg, field, builder.CreatePtrToInt(v, i64Ty),
+      llvm::Align(8), llvm::AtomicOrdering::AcquireRelease);
+
+  auto *old = builder.CreateIntToPtr(oldWord, valueTy);
+  emitNotifyWatches(builder, atom, old, v);
+  return v;
+};
+
+llvm::Value *emitAtomCompareAndSet(llvm::IRBuilder<> &builder,
+                                   llvm::Value *atom, llvm::Value *oldValue,
+                                   llvm::Value *newValue) {
+  auto &ctx = builder.getContext();
+
+  auto *pair = builder.CreateAtomicCmpXchg(
+      getAtomField(builder, atom, types::atomValueOffset), oldValue, newValue,
+      llvm::Align(8), llvm::AtomicOrdering::AcquireRelease,
+      llvm::AtomicOrdering::Acquire);
+  auto *swapped = builder.CreateExtractValue(pair, 1);
+
+  auto *fn      = builder.GetInsertBlock()->getParent();
+  auto *cont    = splitAtInsertPoint(builder, "cas.cont");
+  auto *changed = llvm::BasicBlock::Create(ctx, "cas.changed", fn, cont);
+  builder.CreateCondBr(swapped, changed, cont);
+
+  builder.SetInsertPoint(changed);
+  emitNotifyWatches(builder, atom, oldValue, newValue);
+  builder.CreateBr(cont);
+
+  builder.SetInsertPoint(cont, cont->begin());
+  return swapped;
+};
+
+llvm::Value *emitAtomSwap(llvm::IRBuilder<> &builder, llvm::Value *atom,
+                          AtomUpdate update) {
+  auto &ctx     = builder.getContext();
+  auto *valueTy = getValueType(builder);
+  auto *field   = getAtomField(builder, atom, types::atomValueOffset);
+  auto *current = loadAtomField(builder, atom, types::atomValueOffset,
+                                llvm::AtomicOrdering::Acquire);
+
+  auto *fn    = builder.GetInsertBlock()->getParent();
+  auto *entry = builder.GetInsertBlock();
+  auto *cont  = splitAtInsertPoint(builder, "swap.cont");
+  auto *loop  = llvm::BasicBlock::Create(ctx, "swap.loop", fn, cont);
+  builder.CreateBr(loop);
+
+  //   swap.loop:
+  //     %old  = phi [%current, %entry], [%seen, %retry]
+  //     %new  = <update %old>
+  //     %seen, %ok = cmpxchg %field, %old, %new
+  //     br %ok, %swap.cont, %swap.loop
+  builder.SetInsertPoint(loop);
+  auto *old      = builder.CreatePHI(valueTy, 2, "swap.old");
+  auto *newValue = update(builder, old);
+
+  auto *pair = builder.CreateAtomicCmpXchg(
+      field, old, newValue, llvm::Align(8),
+      llvm::AtomicOrdering::AcquireRelease, llvm::AtomicOrdering::Acquire);
+  auto *seen  = builder.CreateExtractValue(pair, 0);
+  auto *ok    = builder.CreateExtractValue(pair, 1);
+  auto *retry = builder.GetInsertBlock();
+  builder.CreateCondBr(ok, cont, loop,
+                       llvm::MDBuilder(ctx).createBranchWeights(1 << 20, 1));
+
+  old->addIncoming(current, entry);
+  old->addIncoming(seen, retry);
+
+  builder.SetInsertPoint(cont, cont->begin());
+  emitNotifyWatches(builder, atom, old, newValue);
+  return newValue;
+};
+
+} // namespace serene::jit
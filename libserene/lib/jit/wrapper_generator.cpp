@@ -0,0 +1,177 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "serene/jit/wrapper_generator.h"
+
+#include "serene/config.h"
+#include "serene/jit/halley.h" // for HALLEY_LOG
+#include "serene/jit/packer.h"
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace serene::jit {
+
+void SignatureRegistry::record(const llvm::Module &m) {
+  std::vector<std::pair<llvm::StringRef, Signature>> sigs;
+
+  for (const auto &fn : m) {
+    // Internal functions are not visible to other modules, so nobody
+    // can look them up anyway
+    if (fn.isDeclaration() || fn.hasLocalLinkage() ||
+        fn.getName().startswith(PACKED_FUNCTION_NAME_PREFIX)) {
+      continue;
+    }
+
+    std::string type;
+    llvm::raw_string_ostream os(type);
+    fn.getFunctionType()->print(os);
+    os.flush();
+
+    sigs.emplace_back(fn.getName(), Signature{type, fn.getCallingConv()});
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto &sig : sigs) {
+    signatures[sig.first] = std::move(sig.second);
+  }
+};
+
+llvm::Optional<SignatureRegistry::Signature>
+SignatureRegistry::get(llvm::StringRef fnName) const {
+  std::lock_guard<std::mutex> guard(lock);
+  auto i = signatures.find(fnName);
+  if (i == signatures.end()) {
+    return llvm::None;
+  }
+
+  return i->second;
+};
+
+llvm::Expected<llvm::Optional<llvm::orc::ThreadSafeModule>>
+WrapperGenerator::makeWrapperModule(llvm::StringRef wrapperName,
+                                    llvm::StringRef fnName,
+                                    WrapperKind kind) const {
+  auto sig = registry.get(fnName);
+  if (!sig) {
+    return llvm::None;
+  }
+
+  auto ctx = std::make_unique<llvm::LLVMContext>();
+  auto m   = std::make_unique<llvm::Module>(wrapperName, *ctx);
+
+  llvm::SMDiagnostic err;
+  auto *fnTy = llvm::dyn_cast_or_null<llvm::FunctionType>(
+      llvm::parseType(sig->type, err, *m));
+
+  if (fnTy == nullptr) {
+    return llvm::make_error<llvm::StringError>(
+        std::make_error_code(std::errc::executable_format_error),
+        "Invalid signature '" + sig->type + "' for: " + fnName + ". " +
+            err.getMessage());
+  }
+
+  if ((kind == WrapperKind::Direct && !isDirectlyCallable(*fnTy)) ||
+      (kind == WrapperKind::Batch && !isBatchCallable(*fnTy))) {
+    return llvm::None;
+  }
+
+  // Just a declaration, the actual function lives in the same `JITDylib`
+  auto *fn = llvm::Function::Create(fnTy, llvm::Function::ExternalLinkage,
+                                    fnName, *m);
+  fn->setCallingConv(sig->callingConv);
+
+  switch (kind) {
+  case WrapperKind::Packed:
+    definePackedFunction(*m, *fn);
+    break;
+  case WrapperKind::Direct:
+    defineDirectFunction(*m, *fn);
+    break;
+  case WrapperKind::Batch:
+    defineBatchFunction(*m, *fn);
+    break;
+  }
+
+  return llvm::Optional<llvm::orc::ThreadSafeModule>(
+      llvm::orc::ThreadSafeModule(std::move(m), std::move(ctx)));
+};
+
+llvm::Error WrapperGenerator::tryToGenerate(
+    llvm::orc::LookupState &ls, llvm::orc::LookupKind k,
+    llvm::orc::JITDylib &jd, llvm::orc::JITDylibLookupFlags jdLookupFlags,
+    const llvm::orc::SymbolLookupSet &lookupSet) {
+  (void)ls;
+  (void)k;
+  (void)jdLookupFlags;
+
+  // The direct and batch prefixes contain the packed one, so they go first
+  const std::pair<llvm::StringRef, WrapperKind> prefixes[] = {
+      {DIRECT_FUNCTION_NAME_PREFIX, WrapperKind::Direct},
+      {BATCH_FUNCTION_NAME_PREFIX, WrapperKind::Batch},
+      {PACKED_FUNCTION_NAME_PREFIX, WrapperKind::Packed},
+  };
+
+  for (const auto &kv : lookupSet) {
+    llvm::StringRef name = *kv.first;
+
+    if (globalPrefix != '\0') {
+      if (name.empty() || name.front() != globalPrefix) {
+        continue;
+      }
+      name = name.drop_front();
+    }
+
+    const auto *prefix = llvm::find_if(
+        prefixes, [&](const auto &p) { return name.startswith(p.first); });
+    if (prefix == std::end(prefixes)) {
+      continue;
+    }
+
+    auto fnName = name.drop_front(prefix->first.size());
+
+    auto tsm = makeWrapperModule(name, fnName, prefix->second);
+    if (!tsm) {
+      return tsm.takeError();
+    }
+
+    if (!*tsm) {
+      continue;
+    }
+
+    HALLEY_LOG("Generating the wrapper: " << name);
+    if (auto err = layer.add(jd, std::move(**tsm))) {
+      return err;
+    }
+  }
+
+  return llvm::Error::success();
+};
+
+} // namespace serene::jit
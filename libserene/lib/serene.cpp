@@ -19,6 +19,7 @@
 #include "serene/serene.h"
 
 #include "serene/context.h"    // for SereneContext, makeSereneCon...
+#include "serene/gc.h"         // for configureGC
 #include "serene/jit/halley.h" // for makeHalleyJIT, Engine, Maybe...
 
 #include <llvm/ADT/StringRef.h>         // for StringRef
@@ -86,6 +87,8 @@ void initSerene() {
 };
 
 serene::jit::MaybeEngine makeEngine(Options opts) {
+  configureGC(opts);
+
   auto ctx = makeSereneContext(opts);
   return serene::jit::makeHalleyJIT(std::move(ctx));
 };
@@ -0,0 +1,395 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "serene/types/form.h"
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/bit.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/LEB128.h>
+
+#include <cstring>
+#include <system_error>
+
+namespace serene::types {
+
+static uint64_t zigzagEncode(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+};
+
+static int64_t zigzagDecode(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+};
+
+/// Read a varint at `p` and move `p` past it. The input is assumed to be
+/// well formed. See `FormCursor::verify`.
+static uint64_t readVarint(const unsigned char *&p) {
+  // Most of the varints are lengths and IDs that fit in a byte
+  if (*p < 0x80) {
+    return *p++;
+  }
+
+  unsigned n = 0;
+  auto v     = llvm::decodeULEB128(p, &n);
+  p += n;
+  return v;
+};
+
+// ============================================================================
+// FormCursor
+// ============================================================================
+FormKind FormCursor::getKind() const {
+  switch (tag()) {
+  case FormTag::Nil:
+    return FormKind::Nil;
+  case FormTag::True:
+  case FormTag::False:
+    return FormKind::Bool;
+  case FormTag::SmallInt:
+  case FormTag::Int:
+    return FormKind::Int;
+  case FormTag::Float:
+    return FormKind::Float;
+  case FormTag::String:
+    return FormKind::String;
+  case FormTag::Symbol:
+    return FormKind::Symbol;
+  case FormTag::Keyword:
+    return FormKind::Keyword;
+  case FormTag::List:
+    return FormKind::List;
+  case FormTag::Vector:
+    return FormKind::Vector;
+  }
+  llvm_unreachable("Unknown form tag");
+};
+
+bool FormCursor::getBool() const {
+  assert(getKind() == FormKind::Bool && "Not a boolean");
+  return tag() == FormTag::True;
+};
+
+int64_t FormCursor::getInt() const {
+  if (tag() == FormTag::SmallInt) {
+    // Sign extend the lower 7 bits
+    return static_cast<int8_t>(*pos << 1) >> 1;
+  }
+
+  assert(tag() == FormTag::Int && "Not an integer");
+  const auto *p = pos + 1;
+  return zigzagDecode(readVarint(p));
+};
+
+double FormCursor::getFloat() const {
+  assert(tag() == FormTag::Float && "Not a float");
+  return llvm::bit_cast<double>(llvm::support::endian::read64le(pos + 1));
+};
+
+llvm::StringRef FormCursor::getString() const {
+  assert(tag() == FormTag::String && "Not a string");
+  const auto *p = pos + 1;
+  auto len      = readVarint(p);
+  return {reinterpret_cast<const char *>(p), len};
+};
+
+Symbol FormCursor::getSymbol() const {
+  assert(tag() == FormTag::Symbol && "Not a symbol");
+  const auto *p = pos + 1;
+  auto ns       = static_cast<StringID>(readVarint(p));
+  auto name     = static_cast<StringID>(readVarint(p));
+  return {ns, name};
+};
+
+StringID FormCursor::getKeyword() const {
+  assert(tag() == FormTag::Keyword && "Not a keyword");
+  const auto *p = pos + 1;
+  return static_cast<StringID>(readVarint(p));
+};
+
+uint64_t FormCursor::size() const {
+  assert((tag() == FormTag::List || tag() == FormTag::Vector) &&
+         "Not a collection");
+  const auto *p = pos + 1;
+  return readVarint(p);
+};
+
+FormCursor FormCursor::elementsBegin() const {
+  assert((tag() == FormTag::List || tag() == FormTag::Vector) &&
+         "Not a collection");
+  const auto *p = pos + 1;
+  readVarint(p);
+  auto bytes = readVarint(p);
+  return {p, p + bytes};
+};
+
+FormCursor FormCursor::elementsEnd() const {
+  auto begin = elementsBegin();
+  return {begin.end, begin.end};
+};
+
+FormCursor FormCursor::next() const {
+  const auto *p = pos + 1;
+
+  switch (tag()) {
+  case FormTag::Nil:
+  case FormTag::True:
+  case FormTag::False:
+  case FormTag::SmallInt:
+    break;
+  case FormTag::Int:
+  case FormTag::Keyword:
+    readVarint(p);
+    break;
+  case FormTag::Float:
+    p += sizeof(double);
+    break;
+  case FormTag::String:
+    p += readVarint(p);
+    break;
+  case FormTag::Symbol:
+    readVarint(p);
+    readVarint(p);
+    break;
+  case FormTag::List:
+  case FormTag::Vector:
+    return {elementsEnd().pos, end};
+  }
+
+  return {p, end};
+};
+
+static llvm::Error makeVerifyError(const unsigned char *begin,
+                                   const unsigned char *p,
+                                   const llvm::Twine &msg) {
+  return llvm::make_error<llvm::StringError>(
+      "Malformed form at offset " + llvm::Twine(p - begin) + ": " + msg,
+      std::make_error_code(std::errc::illegal_byte_sequence));
+};
+
+/// The maximum nesting of the collections that we accept from the outside
+/// world. Verification recurses on the collections.
+constexpr unsigned maxFormDepth = 1024;
+
+static llvm::Error verifyForms(const unsigned char *begin,
+                               const unsigned char *p,
+                               const unsigned char *end, uint64_t *count,
+                               unsigned depth) {
+  if (depth > maxFormDepth) {
+    return makeVerifyError(begin, p, "Too deeply nested");
+  }
+
+  uint64_t forms = 0;
+
+  auto varint = [&](uint64_t &v) -> llvm::Error {
+    unsigned n        = 0;
+    const char *error = nullptr;
+    v                 = llvm::decodeULEB128(p, &n, end, &error);
+    if (error != nullptr) {
+      return makeVerifyError(begin, p, error);
+    }
+    p += n;
+    return llvm::Error::success();
+  };
+
+  while (p < end) {
+    auto tag = *p;
+    uint64_t v;
+    p++;
+    forms++;
+
+    if (tag >= uint8_t(FormTag::SmallInt)) {
+      continue;
+    }
+
+    switch (FormTag(tag)) {
+    case FormTag::Nil:
+    case FormTag::True:
+    case FormTag::False:
+      break;
+
+    case FormTag::Int:
+    case FormTag::Keyword:
+      if (auto err = varint(v)) {
+        return err;
+      }
+      break;
+
+    case FormTag::Float:
+      if (static_cast<size_t>(end - p) < sizeof(double)) {
+        return makeVerifyError(begin, p, "Truncated float");
+      }
+      p += sizeof(double);
+      break;
+
+    case FormTag::String:
+      if (auto err = varint(v)) {
+        return err;
+      }
+      if (static_cast<uint64_t>(end - p) < v) {
+        return makeVerifyError(begin, p, "Truncated string");
+      }
+      p += v;
+      break;
+
+    case FormTag::Symbol:
+      if (auto err = varint(v)) {
+        return err;
+      }
+      if (auto err = varint(v)) {
+        return err;
+      }
+      break;
+
+    case FormTag::List:
+    case FormTag::Vector: {
+      uint64_t elements, bytes, actual;
+      if (auto err = varint(elements)) {
+        return err;
+      }
+      if (auto err = varint(bytes)) {
+        return err;
+      }
+      if (static_cast<uint64_t>(end - p) < bytes) {
+        return makeVerifyError(begin, p, "Truncated collection");
+      }
+      if (auto err = verifyForms(begin, p, p + bytes, &actual, depth + 1)) {
+        return err;
+      }
+      if (actual != elements) {
+        return makeVerifyError(begin, p, "Wrong number of elements");
+      }
+      p += bytes;
+      break;
+    }
+
+    default:
+      return makeVerifyError(begin, p - 1, "Unknown tag");
+    }
+  }
+
+  *count = forms;
+  return llvm::Error::success();
+};
+
+llvm::Error FormCursor::verify(llvm::ArrayRef<unsigned char> bytes) {
+  uint64_t count;
+  return verifyForms(bytes.begin(), bytes.begin(), bytes.end(), &count, 0);
+};
+
+// ============================================================================
+// FormBuilder
+// ============================================================================
+void FormBuilder::addTag(FormTag t) {
+  if (!open.empty()) {
+    open.back().count++;
+  }
+  buf.push_back(static_cast<unsigned char>(t));
+};
+
+void FormBuilder::addVarint(uint64_t v) {
+  uint8_t tmp[16];
+  auto n = llvm::encodeULEB128(v, tmp);
+  buf.append(tmp, tmp + n);
+};
+
+void FormBuilder::addInt(int64_t v) {
+  if (v >= minSmallInt && v <= maxSmallInt) {
+    addTag(FormTag(uint8_t(FormTag::SmallInt) | (v & 0x7f)));
+    return;
+  }
+
+  addTag(FormTag::Int);
+  addVarint(zigzagEncode(v));
+};
+
+void FormBuilder::addFloat(double v) {
+  addTag(FormTag::Float);
+  auto offset = buf.size();
+  buf.resize(offset + sizeof(double));
+  llvm::support::endian::write64le(&buf[offset],
+                                   llvm::bit_cast<uint64_t>(v));
+};
+
+void FormBuilder::addString(llvm::StringRef s) {
+  addTag(FormTag::String);
+  addVarint(s.size());
+  buf.append(s.bytes_begin(), s.bytes_end());
+};
+
+void FormBuilder::addSymbol(Symbol sym) {
+  addTag(FormTag::Symbol);
+  addVarint(sym.ns);
+  addVarint(sym.name);
+};
+
+void FormBuilder::addKeyword(StringID name) {
+  addTag(FormTag::Keyword);
+  addVarint(name);
+};
+
+void FormBuilder::beginCollection(FormTag t) {
+  addTag(t);
+  open.push_back({buf.size(), 0, headers.size(), 0});
+  headers.push_back({buf.size(), 0, 0});
+};
+
+void FormBuilder::end() {
+  assert(!open.empty() && "No open collection to end");
+  auto c = open.pop_back_val();
+
+  auto size = buf.size() - c.offset + c.nestedHeaderBytes;
+  headers[c.header] = {c.offset, c.count, size};
+
+  auto headerBytes = llvm::getULEB128Size(c.count) + llvm::getULEB128Size(size);
+
+  if (!open.empty()) {
+    // Inserting the header now would move the elements once for every
+    // collection around them
+    open.back().nestedHeaderBytes += headerBytes + c.nestedHeaderBytes;
+    return;
+  }
+
+  spliceHeaders(headerBytes + c.nestedHeaderBytes);
+};
+
+void FormBuilder::spliceHeaders(size_t extraBytes) {
+  auto src = buf.size();
+  buf.resize(src + extraBytes);
+  auto dst = buf.size();
+
+  // Back to front, so every byte moves exactly once
+  for (const auto &h : llvm::reverse(headers)) {
+    auto len = src - h.offset;
+    dst -= len;
+    std::memmove(&buf[dst], &buf[h.offset], len);
+
+    uint8_t header[32];
+    auto n = llvm::encodeULEB128(h.count, header);
+    n += llvm::encodeULEB128(h.size, header + n);
+    dst -= n;
+    std::memcpy(&buf[dst], header, n);
+
+    src = h.offset;
+  }
+
+  assert(dst == src && "The headers don't fill the reserved bytes");
+  headers.clear();
+};
+
+} // namespace serene::types
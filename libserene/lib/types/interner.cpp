@@ -0,0 +1,62 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "serene/types/interner.h"
+
+#include <cassert>
+
+namespace serene::types {
+
+StringID Interner::intern(llvm::StringRef s) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  auto [entry, isNew] = ids.try_emplace(s, strings.size());
+  if (isNew) {
+    assert(strings.size() < llvm::DenseMapInfo<Symbol>::getTombstoneKey().ns &&
+           "Ran out of string IDs");
+    // `getKeyData` is NUL terminated and stable for the life of the map
+    strings.emplace_back(entry->getKeyData(),
+                         static_cast<unsigned int>(entry->getKeyLength()));
+  }
+
+  return entry->getValue();
+};
+
+llvm::Optional<StringID> Interner::find(llvm::StringRef s) const {
+  std::lock_guard<std::mutex> guard(lock);
+
+  auto i = ids.find(s);
+  if (i == ids.end()) {
+    return llvm::None;
+  }
+
+  return i->getValue();
+};
+
+const InternalString &Interner::get(StringID id) const {
+  std::lock_guard<std::mutex> guard(lock);
+  assert(id < strings.size() && "Unknown string ID");
+  return strings[id];
+};
+
+size_t Interner::size() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return strings.size();
+};
+
+} // namespace serene::types
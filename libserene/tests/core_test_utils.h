@@ -0,0 +1,85 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  Helpers for the tests of the data structures and the runtime of
+  `serene.core`.
+ */
+
+#ifndef SERENE_TEST_CORE_TEST_UTILS_H
+#define SERENE_TEST_CORE_TEST_UTILS_H
+
+#include "serene/core/scheduler.h"
+#include "serene/gc.h"
+#include "serene/types/value.h"
+
+#include <gc.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace serene {
+
+/// Keeps the collector from running while it's alive. The tests keep the
+/// versions of the collections that they compare in `std::vector`s, which
+/// the collector doesn't scan.
+struct PauseGC {
+  PauseGC() { GC_disable(); };
+  ~PauseGC() { GC_enable(); };
+
+  PauseGC(const PauseGC &)            = delete;
+  PauseGC &operator=(const PauseGC &) = delete;
+};
+
+/// Runs the scheduler with `workers` workers while it's alive, no matter
+/// how the earlier tests started it. A small pool gets the tests through
+/// the stealing and the waiting paths that a worker per CPU would hide.
+struct ScopedScheduler {
+  explicit ScopedScheduler(uint32_t workers) {
+    schedulerStop();
+    schedulerStart(workers, 0);
+  };
+  ~ScopedScheduler() { schedulerStop(); };
+
+  ScopedScheduler(const ScopedScheduler &)            = delete;
+  ScopedScheduler &operator=(const ScopedScheduler &) = delete;
+};
+
+/// Run `fn(i)` for every `i` below `n` on a thread of its own and wait for
+/// all of them. The threads are registered with the collector.
+template <typename F>
+void runOnThreads(unsigned n, F fn) {
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < n; i++) {
+    threads.emplace_back([&fn, i] {
+      registerGCThread();
+      fn(i);
+      unregisterGCThread();
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+};
+
+inline types::Value fixnum(int64_t i) { return types::makeFixnum(i); };
+
+} // namespace serene
+#endif
@@ -0,0 +1,87 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Commentary:
+  A tiny program that the determinism tests run in separate processes. It
+  reads the IR file that is given as the first argument, makes it
+  deterministic the same way that the engine does in deterministic mode,
+  compiles it to an object file and prints the SHA1 of the object.
+ */
+
+#include "serene/jit/determinism.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h> // for toHex
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    llvm::errs() << "Usage: " << argv[0] << " <ns-name> <ir-file>\n";
+    return 1;
+  }
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  llvm::ExitOnError exitOnErr("determinism-helper: ");
+  llvm::LLVMContext ctx;
+  llvm::SMDiagnostic diag;
+
+  auto m = llvm::parseIRFile(argv[2], diag, ctx);
+  if (!m) {
+    diag.print(argv[0], llvm::errs());
+    return 1;
+  }
+
+  serene::jit::makeModuleDeterministic(*m, argv[1]);
+
+  llvm::orc::JITTargetMachineBuilder jtmb(
+      llvm::Triple(llvm::sys::getProcessTriple()));
+  auto tm = exitOnErr(jtmb.createTargetMachine());
+
+  m->setDataLayout(tm->createDataLayout());
+  m->setTargetTriple(tm->getTargetTriple().str());
+
+  llvm::SmallVector<char, 0> obj;
+  llvm::raw_svector_ostream os(obj);
+  llvm::legacy::PassManager pm;
+
+  if (tm->addPassesToEmitFile(pm, os, nullptr, llvm::CGFT_ObjectFile)) {
+    llvm::errs() << "determinism-helper: can't emit object files\n";
+    return 1;
+  }
+
+  pm.run(*m);
+
+  llvm::outs() << llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(
+                      llvm::StringRef(obj.data(), obj.size()))))
+               << "\n";
+  return 0;
+};
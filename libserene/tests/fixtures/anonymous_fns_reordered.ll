@@ -0,0 +1,22 @@
+; The same namespace as `anonymous_fns.ll` compiled in a different order
+; on another machine. The anonymous functions got swapped numbers.
+source_filename = "/tmp/build/some/ns.srn"
+
+define i64 @"some.ns/main"(i64 %x) {
+entry:
+  %a = call i64 @___fn___1(i64 %x)
+  %b = call i64 @___fn___0(i64 %a)
+  ret i64 %b
+}
+
+define internal i64 @___fn___0(i64 %x) {
+entry:
+  %r = mul i64 %x, 2
+  ret i64 %r
+}
+
+define internal i64 @___fn___1(i64 %x) {
+entry:
+  %r = add i64 %x, 1
+  ret i64 %r
+}
@@ -0,0 +1,73 @@
+; A namespace with two mutually recursive anonymous functions, a third
+; one that calls them and an identical copy of the cycle.
+source_filename = "/home/someone/src/some/ns.srn"
+
+define internal i64 @___fn___0(i64 %x) {
+entry:
+  %c = icmp eq i64 %x, 0
+  br i1 %c, label %done, label %next
+
+done:
+  ret i64 1
+
+next:
+  %y = sub i64 %x, 1
+  %r = call i64 @___fn___1(i64 %y)
+  ret i64 %r
+}
+
+define internal i64 @___fn___1(i64 %x) {
+entry:
+  %c = icmp eq i64 %x, 0
+  br i1 %c, label %done, label %next
+
+done:
+  ret i64 0
+
+next:
+  %y = sub i64 %x, 1
+  %r = call i64 @___fn___0(i64 %y)
+  ret i64 %r
+}
+
+define internal i64 @___fn___2(i64 %x) {
+entry:
+  %a = call i64 @___fn___0(i64 %x)
+  %b = call i64 @___fn___4(i64 %x)
+  %r = add i64 %a, %b
+  ret i64 %r
+}
+
+define internal i64 @___fn___3(i64 %x) {
+entry:
+  %c = icmp eq i64 %x, 0
+  br i1 %c, label %done, label %next
+
+done:
+  ret i64 1
+
+next:
+  %y = sub i64 %x, 1
+  %r = call i64 @___fn___4(i64 %y)
+  ret i64 %r
+}
+
+define internal i64 @___fn___4(i64 %x) {
+entry:
+  %c = icmp eq i64 %x, 0
+  br i1 %c, label %done, label %next
+
+done:
+  ret i64 0
+
+next:
+  %y = sub i64 %x, 1
+  %r = call i64 @___fn___3(i64 %y)
+  ret i64 %r
+}
+
+define i64 @"some.ns/main"(i64 %x) {
+entry:
+  %r = call i64 @___fn___2(i64 %x)
+  ret i64 %r
+}
@@ -0,0 +1,74 @@
+; The same namespace as `cyclic_anonymous_fns.ll` compiled in a different
+; order. The members of the cycles got different numbers and are defined
+; in a different order.
+source_filename = "/tmp/build/some/ns.srn"
+
+define i64 @"some.ns/main"(i64 %x) {
+entry:
+  %r = call i64 @___fn___0(i64 %x)
+  ret i64 %r
+}
+
+define internal i64 @___fn___1(i64 %x) {
+entry:
+  %c = icmp eq i64 %x, 0
+  br i1 %c, label %done, label %next
+
+done:
+  ret i64 0
+
+next:
+  %y = sub i64 %x, 1
+  %r = call i64 @___fn___4(i64 %y)
+  ret i64 %r
+}
+
+define internal i64 @___fn___2(i64 %x) {
+entry:
+  %c = icmp eq i64 %x, 0
+  br i1 %c, label %done, label %next
+
+done:
+  ret i64 0
+
+next:
+  %y = sub i64 %x, 1
+  %r = call i64 @___fn___3(i64 %y)
+  ret i64 %r
+}
+
+define internal i64 @___fn___0(i64 %x) {
+entry:
+  %a = call i64 @___fn___3(i64 %x)
+  %b = call i64 @___fn___1(i64 %x)
+  %r = add i64 %a, %b
+  ret i64 %r
+}
+
+define internal i64 @___fn___3(i64 %x) {
+entry:
+  %c = icmp eq i64 %x, 0
+  br i1 %c, label %done, label %next
+
+done:
+  ret i64 1
+
+next:
+  %y = sub i64 %x, 1
+  %r = call i64 @___fn___2(i64 %y)
+  ret i64 %r
+}
+
+define internal i64 @___fn___4(i64 %x) {
+entry:
+  %c = icmp eq i64 %x, 0
+  br i1 %c, label %done, label %next
+
+done:
+  ret i64 1
+
+next:
+  %y = sub i64 %x, 1
+  %r = call i64 @___fn___1(i64 %y)
+  ret i64 %r
+}
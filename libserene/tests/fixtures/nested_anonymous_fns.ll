@@ -0,0 +1,49 @@
+; A namespace with anonymous functions that call other anonymous
+; functions. The outer ones only differ in the inner one that they call.
+; The last two are identical.
+source_filename = "/home/someone/src/some/ns.srn"
+
+define internal i64 @___fn___0() {
+entry:
+  ret i64 1
+}
+
+define internal i64 @___fn___1() {
+entry:
+  ret i64 2
+}
+
+define internal i64 @___fn___2(i64 %x) {
+entry:
+  %a = call i64 @___fn___0()
+  %r = add i64 %x, %a
+  ret i64 %r
+}
+
+define internal i64 @___fn___3(i64 %x) {
+entry:
+  %a = call i64 @___fn___1()
+  %r = add i64 %x, %a
+  ret i64 %r
+}
+
+define internal i64 @___fn___4(i64 %x) {
+entry:
+  %r = mul i64 %x, 7
+  ret i64 %r
+}
+
+define internal i64 @___fn___5(i64 %x) {
+entry:
+  %r = mul i64 %x, 7
+  ret i64 %r
+}
+
+define i64 @"some.ns/main"(i64 %x) {
+entry:
+  %a = call i64 @___fn___2(i64 %x)
+  %b = call i64 @___fn___3(i64 %a)
+  %c = call i64 @___fn___4(i64 %b)
+  %d = call i64 @___fn___5(i64 %c)
+  ret i64 %d
+}
@@ -0,0 +1,49 @@
+; The same namespace as `nested_anonymous_fns.ll` compiled in a different
+; order. The inner functions got swapped numbers and are defined after
+; the outer ones.
+source_filename = "/tmp/build/some/ns.srn"
+
+define i64 @"some.ns/main"(i64 %x) {
+entry:
+  %a = call i64 @___fn___0(i64 %x)
+  %b = call i64 @___fn___1(i64 %a)
+  %c = call i64 @___fn___5(i64 %b)
+  %d = call i64 @___fn___4(i64 %c)
+  ret i64 %d
+}
+
+define internal i64 @___fn___4(i64 %x) {
+entry:
+  %r = mul i64 %x, 7
+  ret i64 %r
+}
+
+define internal i64 @___fn___0(i64 %x) {
+entry:
+  %a = call i64 @___fn___3()
+  %r = add i64 %x, %a
+  ret i64 %r
+}
+
+define internal i64 @___fn___1(i64 %x) {
+entry:
+  %a = call i64 @___fn___2()
+  %r = add i64 %x, %a
+  ret i64 %r
+}
+
+define internal i64 @___fn___2() {
+entry:
+  ret i64 2
+}
+
+define internal i64 @___fn___3() {
+entry:
+  ret i64 1
+}
+
+define internal i64 @___fn___5(i64 %x) {
+entry:
+  %r = mul i64 %x, 7
+  ret i64 %r
+}
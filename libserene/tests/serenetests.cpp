@@ -0,0 +1,48 @@
+/* -*- C++ -*-
+ * Serene Programming Language
+ *
+ * Copyright (c) 2019-2022 Sameer Rahmani <lxsameer@gnu.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "./arena_tests.cpp.inc"
+#include "./atom_tests.cpp.inc"
+#include "./channel_tests.cpp.inc"
+#include "./determinism_tests.cpp.inc"
+#include "./form_tests.cpp.inc"
+#include "./gc_tests.cpp.inc"
+#include "./hash_map_tests.cpp.inc"
+#include "./interner_tests.cpp.inc"
+#include "./number_tests.cpp.inc"
+#include "./object_cache_tests.cpp.inc"
+#include "./reducers_tests.cpp.inc"
+#include "./require_tests.cpp.inc"
+#include "./scheduler_tests.cpp.inc"
+#include "./seq_tests.cpp.inc"
+#include "./statepoints_tests.cpp.inc"
+#include "./transducer_tests.cpp.inc"
+#include "./transient_tests.cpp.inc"
+#include "./values_tests.cpp.inc"
+#include "./vector_tests.cpp.inc"
+
+#include "serene/serene.h"
+
+#include <catch2/catch_all.hpp>
+#include <catch2/catch_session.hpp>
+
+int main(int argc, char *argv[]) {
+  // The engine needs the targets and the collector like any other host
+  SERENE_INIT();
+  return Catch::Session().run(argc, argv);
+};
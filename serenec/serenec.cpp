@@ -298,14 +298,14 @@ int main(int argc, char *argv[]) {
   //   return 1;
   // }
 
-  std::string core = "serene.core";
-  auto maybeCore   = engine->loadNamespace(core);
+  auto maybeCore = engine->require("serene.core");
   if (!maybeCore) {
     llvm::errs() << "Error: " << maybeCore.takeError() << "'\n";
     return 1;
   }
 
-  auto bt = engine->lookup("serene.core", "compile");
+  // Core functions are plain C functions, so there is no wrapper for them
+  auto bt = engine->lookupAddress("serene.core", "serene.core/compile");
 
   if (!bt) {
     llvm::errs() << "Error: " << bt.takeError() << "'\n";